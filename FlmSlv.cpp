@@ -9,1047 +9,4975 @@
 #include <tuple>
 #include <set>
 #include <algorithm>
-#include <regex>
 #include <map>
 #include <filesystem>
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <climits>
+#include <mutex>
+#include <condition_variable>
+#include <csignal>
+#include <deque>
+#include <memory>
+#include <cstdio>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <random>
+#include <numeric>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
 namespace fs = std::filesystem;
 using namespace std;
-vector<tuple<int, int, int>> fixedCells; //For sat solver
 
 bool depthExperiment = true;
 
 bool showIntermediateProcess = false;
-int Height = 10;
-int Width = 10;
 const int DIRECTIONS[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}}; // Up, Down, Left, Right
-int maxNumOnBoard = 9;
+const int DEFAULT_MAX_NUM = 9;
 
 bool showDepth = false;
-int maxDepth = 0;
-std::map<int, int> depthGapHistogram;
 
-// make a board with 0's
-std::vector<std::vector<int>> board(Height, std::vector<int>(Width, 0));
+typedef uint8_t Cell;
+const Cell BORDER = 255; //sentinel around the board, never equal to 0 or a number
+
+typedef uint64_t NumberMask; //one bit per number slot, see SolverContext::numberSlot
+const int MAX_NUMBER_SLOTS = 64;
+
+//Board cells stored row by row in one array with a one cell border of sentinels around it,
+//so neighbours can be visited with the precomputed offsets and without bounds checks.
+struct Board {
+    int height = 0;
+    int width = 0;
+    int stride = 0;
+    int offsets[4]; // Up, Down, Left, Right (same order as DIRECTIONS)
+    vector<Cell> cells;
+    vector<int> rows, cols; //of every index, the border gives -1 and height or width
+
+    Board(int h = 0, int w = 0) { resize(h, w); }
+
+    //make a board with 0's
+    void resize(int h, int w) {
+        height = h;
+        width = w;
+        stride = w + 2;
+        for (int d = 0; d < 4; d++) {
+            offsets[d] = DIRECTIONS[d][0] * stride + DIRECTIONS[d][1];
+        }
+        cells.assign((h + 2) * stride, BORDER);
+        for (int i = 0; i < h; i++) {
+            fill_n(&cells[index(i, 0)], w, 0);
+        }
+        //row() and col() are hot in the flood kernels, a table is cheaper than the division
+        rows.resize(cells.size());
+        cols.resize(cells.size());
+        for (size_t idx = 0; idx < cells.size(); idx++) {
+            rows[idx] = idx / stride - 1;
+            cols[idx] = idx % stride - 1;
+        }
+    }
 
-struct Group {
-    int number;
-    vector<pair<int, int>> cells;
+    int index(int i, int j) const { return (i + 1) * stride + j + 1; }
+    int row(int idx) const { return rows[idx]; }
+    int col(int idx) const { return cols[idx]; }
+
+    //board[i][j] still works, rows point into the flat array
+    Cell* operator[](int i) { return &cells[index(i, 0)]; }
+    const Cell* operator[](int i) const { return &cells[index(i, 0)]; }
 };
 
-vector<Group> globalGroups;
+//Dimensions of the board for the kernels that are instantiated per board size, see boardKernels(). With
+//FixedShape the stride, the neighbour offsets and the loop bounds are constants the compiler can fold.
+template <int H, int W>
+struct FixedShape {
+    static constexpr int height = H;
+    static constexpr int width = W;
+    static constexpr int stride = W + 2;
+    static constexpr int offsets[4] = {-stride, stride, -1, 1}; //same order as DIRECTIONS
+
+    explicit FixedShape(const Board&) {}
+    static constexpr int index(int i, int j) { return (i + 1) * stride + j + 1; }
+};
 
+//the fallback for every other size, read from the board
+struct RuntimeShape {
+    int height;
+    int width;
+    int stride;
+    int offsets[4];
 
-class FillominoSMTSolver {
-public:
-    int rows, cols;
+    explicit RuntimeShape(const Board& board) : height(board.height), width(board.width), stride(board.stride) {
+        copy(board.offsets, board.offsets + 4, offsets);
+    }
+    int index(int i, int j) const { return (i + 1) * stride + j + 1; }
+};
 
-    FillominoSMTSolver() {}
+//splitmix64 finalizer, used for the Zobrist keys of (cell, number) pairs
+uint64_t mixHash(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
 
-    vector<pair<int, int>> adj(int row, int col) {
-        vector<pair<int, int>> neighbors;
-        if (row - 1 >= 0) neighbors.emplace_back(row - 1, col);
-        if (row + 1 < rows) neighbors.emplace_back(row + 1, col);
-        if (col - 1 >= 0) neighbors.emplace_back(row, col - 1);
-        if (col + 1 < cols) neighbors.emplace_back(row, col + 1);
-        return neighbors;
+uint64_t zobristKey(int cell, int number) {
+    return mixHash((uint64_t)cell << 8 | number);
+}
+
+//A set of cells as bits, row by row: column j of row i is bit j % 64 of word j / 64 of the row. The empty
+//row above and below the board lets floodStep read the neighbouring rows without checks.
+struct BitGrid {
+    int height = 0;
+    int width = 0;
+    int rowWords = 0;
+    vector<uint64_t> words;
+
+    void resize(int h, int w) {
+        height = h;
+        width = w;
+        rowWords = (w + 63) / 64;
+        words.assign((h + 2) * rowWords, 0);
     }
 
-    string solve(int r, int c, const vector<tuple<int, int, int>>& nums) {
-        ostringstream oss;
+    void clear() { fill(words.begin(), words.end(), 0); }
+    void clearRows(int begin, int end) { fill(row(begin), row(end), 0); }
+    uint64_t* row(int i) { return &words[(i + 1) * rowWords]; }
+    const uint64_t* row(int i) const { return &words[(i + 1) * rowWords]; }
+    void set(int i, int j) { row(i)[j >> 6] |= uint64_t(1) << (j & 63); }
+    void reset(int i, int j) { row(i)[j >> 6] &= ~(uint64_t(1) << (j & 63)); }
+
+    int count(int rowBegin, int rowEnd) const {
+        int n = 0;
+        for (const uint64_t* word = row(rowBegin); word != row(rowEnd); word++) n += __builtin_popcountll(*word);
+        return n;
+    }
+};
 
-        oss << "(set-option :print-success false)" << "\n";
-        oss << "(set-logic QF_UFLIA)" << "\n";
+//One step of a flood fill over rows [rowBegin, rowEnd): to gets from plus every cell next to it that is in
+//mask or in also, false when nothing was added. Rows of from just outside the range must be empty. from and to may be the
+//same grid when the number of steps does not matter, the fill then runs ahead within a step. Rows only
+//depend on their neighbours, so with AVX2 four one-word rows go at once; the plain loop is the fallback
+//and handles rows wider than 64 cells.
+bool floodStep(const BitGrid& from, const BitGrid& mask, const BitGrid& also, BitGrid& to, int rowBegin, int rowEnd) {
+    int rowWords = from.rowWords;
+    int words = (rowEnd - rowBegin) * rowWords;
+    const uint64_t* in = from.row(rowBegin);
+    const uint64_t* allowed = mask.row(rowBegin);
+    const uint64_t* allowedToo = also.row(rowBegin);
+    uint64_t* out = to.row(rowBegin);
+    uint64_t grown = 0;
+    int k = 0;
+#ifdef __AVX2__
+    if (rowWords == 1 && &from != &to) {
+        __m256i changed = _mm256_setzero_si256();
+        for (; k + 4 <= words; k += 4) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(in + k));
+            __m256i up = _mm256_loadu_si256((const __m256i*)(in + k - 1));
+            __m256i down = _mm256_loadu_si256((const __m256i*)(in + k + 1));
+            __m256i spread = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi64(x, 1), _mm256_srli_epi64(x, 1)),
+                                             _mm256_or_si256(up, down));
+            __m256i open = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(allowed + k)),
+                                           _mm256_loadu_si256((const __m256i*)(allowedToo + k)));
+            __m256i next = _mm256_or_si256(x, _mm256_and_si256(spread, open));
+            _mm256_storeu_si256((__m256i*)(out + k), next);
+            changed = _mm256_or_si256(changed, _mm256_xor_si256(next, x));
+        }
+        grown = !_mm256_testz_si256(changed, changed);
+    }
+#endif
+    for (; k < words; k++) {
+        uint64_t x = in[k];
+        uint64_t spread = in[k - rowWords] | in[k + rowWords] | (x << 1) | (x >> 1);
+        if (rowWords > 1) {
+            //bits that cross into the next or previous word of the row
+            int column = k % rowWords;
+            if (column > 0) spread |= in[k - 1] >> 63;
+            if (column + 1 < rowWords) spread |= in[k + 1] << 63;
+        }
+        uint64_t next = x | (spread & (allowed[k] | allowedToo[k]));
+        grown |= next ^ x;
+        out[k] = next;
+    }
+    return grown != 0;
+}
 
-        rows = r;
-        cols = c;
+struct GroupNode {
+    int parent;    //-1 for empty cells
+    int size;      //cells in the group, kept at the root
+    int liberties; //edges from group cells to empty cells, kept at the root
+    int next;      //circular list through the cells of the group
+};
 
-		//we define edges e_{x}_{y} between cells. 1 if there exists one between two cells, else 0
-        for (int row1 = 0; row1 < rows; row1++) {
-            for (int col1 = 0; col1 < cols; col1++) {
-                int x = row1 * cols + col1;
-                for (auto [row2, col2] : adj(row1, col1)) {
-                    int y = row2 * cols + col2;
-                    oss << "(declare-fun e_" << x << "_" << y << " () Int)" << "\n";
-                    oss << "(assert (or (= e_" << x << "_" << y << " 0) (= e_" << x << "_" << y << " 1)))" << "\n";
-                }
-            }
-        }
+//Groups of equal numbers tracked with a union-find over the board indices. Filling a cell merges it
+//with its neighbours, and every node that changes is logged so fills can be undone in reverse order.
+//There is no path compression (it could not be undone), union by size keeps find() short instead.
+struct GroupTracker {
+    struct Fill {
+        int cell;
+        int number;
+        size_t logSize;
+        int wrongSizeGroups;
+        int overfilledGroups;
+        uint64_t hash;
+    };
+
+    vector<GroupNode> nodes;
+    vector<pair<int, GroupNode>> log;
+    vector<Fill> fills;
+    int wrongSizeGroups = 0; //groups that are not exactly filled
+    int overfilledGroups = 0;
+    uint64_t hash = 0; //Zobrist hash of the board dimensions and every filled (cell, number), follows add and undo
+
+    //the cells as bitboards for the flood kernels, follow add and undo too
+    int stride = 0;
+    BitGrid emptyGrid;
+    vector<BitGrid> numberGrids; //per number, sized when the number first shows up
+    vector<Cell> rebuildValues; //kept between rebuilds so they don't allocate
+
+    BitGrid& numberGrid(int number) {
+        BitGrid& grid = numberGrids[number];
+        if (grid.words.empty()) grid.resize(emptyGrid.height, emptyGrid.width);
+        return grid;
+    }
 
-		//We cant have an edge between cells in both directions, only one direction.
-        for (int row1 = 0; row1 < rows; row1++) {
-            for (int col1 = 0; col1 < cols; col1++) {
-                int x = row1 * cols + col1;
-                for (auto [row2, col2] : adj(row1, col1)) {
-                    int y = row2 * cols + col2;
-                    oss << "(assert (<= (+ e_" << x << "_" << y << " e_" << y << "_" << x << ") 1))" << "\n";
-                }
-            }
+    int find(int cell) const {
+        while (nodes[cell].parent != cell) {
+            cell = nodes[cell].parent;
         }
+        return cell;
+    }
 
-		//each cell is allowed to have at most one incoming edge (tree structure)
-        for (int row1 = 0; row1 < rows; row1++) {
-            for (int col1 = 0; col1 < cols; col1++) {
-                int x = row1 * cols + col1;
-                oss << "(assert (<= (+" << "\n";
-                for (auto [row2, col2] : adj(row1, col1)) {
-                    int y = row2 * cols + col2;
-                    oss << "               e_" << y << "_" << x << "\n";
-                }
-                oss << ") 1))" << "\n";
-            }
-        }
+    bool isRoot(int cell) const { return nodes[cell].parent == cell; }
 
-		//number variable for each cell
-        for (int row = 0; row < rows; row++) {
-            for (int col = 0; col < cols; col++) {
-                int x = row * cols + col;
-                oss << "(declare-fun n_" << x << " () Int)" << "\n";
-            }
-        }
+    void save(int cell) { log.emplace_back(cell, nodes[cell]); }
 
-		//If we already know if certain cells contain a certain number, we assign them.
-        for (auto [i, j, k] : nums) {
-            int x = i * cols + j;
-            oss << "(assert (= n_" << x << " " << k << "))" << "\n";
-        }
+    void countGroup(int root, int number, int delta) {
+        if (nodes[root].size != number) wrongSizeGroups += delta;
+        if (nodes[root].size > number) overfilledGroups += delta;
+    }
 
-		//size constraint for regions
-        for (int row = 0; row < rows; row++) {
-            for (int col = 0; col < cols; col++) {
-                int x = row * cols + col;
-                oss << "(declare-fun s_" << x << " () Int)" << "\n";
-            }
-        }
+    void unite(int a, int b, int number) {
+        if (a == b) return;
+        countGroup(a, number, -1);
+        countGroup(b, number, -1);
+        if (nodes[a].size < nodes[b].size) swap(a, b);
+        save(a);
+        save(b);
+        nodes[b].parent = a;
+        nodes[a].size += nodes[b].size;
+        nodes[a].liberties += nodes[b].liberties;
+        swap(nodes[a].next, nodes[b].next);
+        countGroup(a, number, 1);
+    }
 
-		//s_x =  (sum of the sizes of the neighbours connected from this cell) + 1.
-        for (int row1 = 0; row1 < rows; row1++) {
-            for (int col1 = 0; col1 < cols; col1++) {
-                int x = row1 * cols + col1;
-                oss << "(assert (= s_" << x << " (+ 1" << "\n";
-                for (auto [row2, col2] : adj(row1, col1)) {
-                    int y = row2 * cols + col2;
-                    oss << "                   (ite (= e_" << x << "_" << y << " 1) s_" << y << " 0)" << "\n";
-                }
-                oss << ")))" << "\n";
+    //board.cells[cell] has just been set to a number
+    void add(const Board& board, int cell) {
+        int number = board.cells[cell];
+        fills.push_back({cell, number, log.size(), wrongSizeGroups, overfilledGroups, hash});
+        hash ^= zobristKey(cell, number);
+        emptyGrid.reset(board.row(cell), board.col(cell));
+        numberGrid(number).set(board.row(cell), board.col(cell));
+
+        save(cell);
+        nodes[cell] = {cell, 1, 0, cell};
+        for (int offset : board.offsets) {
+            int next = cell + offset;
+            if (board.cells[next] == 0) {
+                nodes[cell].liberties++;
+            } else if (board.cells[next] != BORDER) {
+                //this cell was an open edge of the neighbouring group
+                int root = find(next);
+                save(root);
+                nodes[root].liberties--;
             }
         }
+        countGroup(cell, number, 1);
 
-		//if there are no incoming edges, s_x has to equal n_x
-        for (int row1 = 0; row1 < rows; row1++) {
-            for (int col1 = 0; col1 < cols; col1++) {
-                int x = row1 * cols + col1;
-                oss << "(assert (=> (= (+" << "\n";
-                for (auto [row2, col2] : adj(row1, col1)) {
-                    int y = row2 * cols + col2;
-                    oss << "                  e_" << y << "_" << x << "\n";
-                }
-                oss << ") 0) (= s_" << x << " n_" << x << ")))" << "\n";
+        for (int offset : board.offsets) {
+            int next = cell + offset;
+            if (board.cells[next] == number) {
+                unite(find(cell), find(next), number);
             }
         }
+    }
 
-		//all cells in the same region must have the same number
-        for (int row1 = 0; row1 < rows; row1++) {
-            for (int col1 = 0; col1 < cols; col1++) {
-                int x = row1 * cols + col1;
-                for (auto [row2, col2] : adj(row1, col1)) {
-                    int y = row2 * cols + col2;
-                    oss << "(assert (=> (= e_" << x << "_" << y << " 1) (= n_" << x << " n_" << y << ")))" << "\n";
-                }
-            }
+    //undoes the last add, the caller still has to clear the returned cell on the board
+    int undo() {
+        Fill fill = fills.back();
+        fills.pop_back();
+        while (log.size() > fill.logSize) {
+            nodes[log.back().first] = log.back().second;
+            log.pop_back();
         }
+        wrongSizeGroups = fill.wrongSizeGroups;
+        overfilledGroups = fill.overfilledGroups;
+        hash = fill.hash;
+        int i = fill.cell / stride - 1, j = fill.cell % stride - 1;
+        emptyGrid.set(i, j);
+        numberGrids[fill.number].reset(i, j);
+        return fill.cell;
+    }
 
-		//declare root variable for each cell
-        for (int row = 0; row < rows; row++) {
-            for (int col = 0; col < cols; col++) {
-                int x = row * cols + col;
-                oss << "(declare-fun r_" << x << " () Int)" << "\n";
+    //start over from the numbers on the board, the result cannot be undone
+    void rebuild(Board& board) {
+        rebuildValues.assign(board.cells.begin(), board.cells.end());
+        const vector<Cell>& values = rebuildValues;
+        nodes.assign(board.cells.size(), {-1, 0, 0, -1});
+        log.clear();
+        fills.clear();
+        wrongSizeGroups = 0;
+        overfilledGroups = 0;
+        hash = mixHash(~((uint64_t)board.height << 32 | board.width));
+        stride = board.stride;
+        emptyGrid.resize(board.height, board.width);
+        for (int i = 0; i < board.height; i++) {
+            for (int j = 0; j < board.width; j++) {
+                emptyGrid.set(i, j);
             }
         }
+        //emptied rather than replaced, numberGrid sizes them again in their old memory
+        numberGrids.resize(256);
+        for (BitGrid& grid : numberGrids) grid.words.clear();
 
-		//cells with no incoming edges are roots.
-        for (int row1 = 0; row1 < rows; row1++) {
-            for (int col1 = 0; col1 < cols; col1++) {
-                int x = row1 * cols + col1;
-                oss << "(assert (=> (= (+" << "\n";
-                for (auto [row2, col2] : adj(row1, col1)) {
-                    int y = row2 * cols + col2;
-                    oss << "                  e_" << y << "_" << x << "\n";
-                }
-                oss << ") 0) (= r_" << x << " " << x << ")))" << "\n";
-            }
+        for (int i = 0; i < board.height; i++) {
+            fill_n(&board.cells[board.index(i, 0)], board.width, 0);
         }
-
-		//connected cells in the same region, must have the same root.
-        for (int row1 = 0; row1 < rows; row1++) {
-            for (int col1 = 0; col1 < cols; col1++) {
-                int x = row1 * cols + col1;
-                for (auto [row2, col2] : adj(row1, col1)) {
-                    int y = row2 * cols + col2;
-                    oss << "(assert (=> (= n_" << x << " n_" << y << ") (= r_" << x << " r_" << y << ")))" << "\n";
+        for (int i = 0; i < board.height; i++) {
+            for (int j = 0; j < board.width; j++) {
+                int cell = board.index(i, j);
+                if (values[cell] != 0) {
+                    board.cells[cell] = values[cell];
+                    add(board, cell);
                 }
             }
         }
+        log.clear();
+        fills.clear();
+    }
+};
 
-        oss << "(check-sat)" << "\n";
+//Counters and strategy timers of one solve. Building with -DFLMSLV_NO_STATS turns STAT_ADD and
+//STAT_TIMER into nothing, so the hot paths pay for them only when they are wanted.
+struct SolveStats {
+    long long reachabilityPasses = 0; //computeReachability, which replaced the per-cell canReach() BFS
+    long long groupSizeCalls = 0;
+    long long groupRebuilds = 0; //findAndStoreGroups
+    long long completionChecks = 0; //canGroupBeCompleted
+    long long singleExitFills = 0;
+    long long reachableFills = 0;
+    long long definitiveFills = 0;
+    long long singleExitNs = 0;
+    long long reachableNs = 0;
+    long long definitiveNs = 0;
+    long long searchNodes = 0;
+    long long failures = 0;   //nodes that ran into a contradiction
+    long long backtracks = 0; //branches undone after they failed
+    long long heapAllocations = 0; //operator new calls of the solving threads
+
+    void add(const SolveStats& other) {
+        reachabilityPasses += other.reachabilityPasses;
+        groupSizeCalls += other.groupSizeCalls;
+        groupRebuilds += other.groupRebuilds;
+        completionChecks += other.completionChecks;
+        singleExitFills += other.singleExitFills;
+        reachableFills += other.reachableFills;
+        definitiveFills += other.definitiveFills;
+        singleExitNs += other.singleExitNs;
+        reachableNs += other.reachableNs;
+        definitiveNs += other.definitiveNs;
+        searchNodes += other.searchNodes;
+        failures += other.failures;
+        backtracks += other.backtracks;
+        heapAllocations += other.heapAllocations;
+    }
+};
 
-        for (int row = 0; row < rows; row++) {
-            for (int col = 0; col < cols; col++) {
-                int x = row * cols + col;
-                oss << "(get-value (n_" << x << "))" << "\n";
-            }
-        }
+//adds the time until the end of the scope to a nanosecond counter
+struct StatTimer {
+    long long& total;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
 
-        return oss.str();
-    }
+    explicit StatTimer(long long& total) : total(total) {}
+    ~StatTimer() { total += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count(); }
 };
 
+//Heap allocations of the current thread, counted by the global operator new below. The solve paths are
+//meant to allocate while a board is loaded and not per search node, SolveStats::heapAllocations shows it.
+thread_local long long threadAllocations = 0;
 
-bool loadSMTsolvedBoard(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file) {
-        std::cout << "cannot open the file:" << filename << std::endl;
-        return false;
+#ifndef FLMSLV_NO_STATS
+void* operator new(size_t size) {
+    threadAllocations++;
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+//gcc pairs operator new with operator delete and does not know this new comes from malloc
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#define STAT_ADD(field, amount) (stats.field += (amount))
+#define STAT_TIMER(field) StatTimer field##Timer(stats.field)
+#else
+#define STAT_ADD(field, amount) ((void)0)
+#define STAT_TIMER(field) ((void)0)
+#endif
+
+//Position in the undo history of a SolverContext, see trailMark() and undoTo()
+struct TrailMark {
+    size_t fills;
+    size_t domainChanges;
+};
+
+//Which empty cell solveWithBacktracking branches on
+enum class CellHeuristic {
+    FirstEmpty,          //first empty cell in row-major order
+    FewestCandidates,    //smallest domain (MRV)
+    NearlyCompleteGroup, //next to the group that needs the fewest cells, smallest domain on ties
+};
+
+//In which order the numbers of the branch cell are tried
+enum class ValueOrder {
+    Ascending,
+    GroupSlack, //numbers of neighbouring groups that need the fewest cells first
+};
+
+//How computeReachability and canAllGroupsBeCompleted flood the board
+enum class FloodKernel {
+    Bfs,      //a queue per group
+    Bitboard, //whole rows per step, see floodStep
+    Check     //both, counting the places where they disagree in SolverContext::kernelMismatches
+};
+
+//How applyAllDeterministicFilling picks its strategies
+enum class StrategySchedule {
+    Fixed,   //all of them, in the order of DEDUCTION_STRATEGIES
+    Adaptive //cheapest per filled cell first, idle ones only now and then, see StrategyScheduler
+};
+
+enum class Engine {
+    Backtracking, //deterministic filling plus search
+    Sat,          //the built-in CDCL solver on a CNF encoding of the puzzle
+    Portfolio     //backtracking raced against an external SMT solver
+};
+
+struct SolveOptions {
+    Engine engine = Engine::Backtracking;
+    string smtCommand = "z3 -in"; //run with /bin/sh by the portfolio, reads SMT-LIB on stdin
+    CellHeuristic cellHeuristic = CellHeuristic::FirstEmpty;
+    ValueOrder valueOrder = ValueOrder::Ascending;
+#ifdef __AVX2__
+    FloodKernel floodKernel = FloodKernel::Bitboard; //about 20% faster than bfs on the samples with avx2
+#else
+    FloodKernel floodKernel = FloodKernel::Bfs;      //the scalar bitboard is about 20% slower
+#endif
+    bool specializedKernels = true; //kernels compiled for the common board sizes, see boardKernels()
+    StrategySchedule strategySchedule = StrategySchedule::Adaptive;
+    //Size of the table of refuted boards, 0 turns it off. One search never meets the same board twice (the
+    //branches of a node differ in the branch cell), so the table pays off when one context solves related boards.
+    size_t refutationTableMB = 0;
+
+    //limits of one solve() call, 0 for none
+    double timeLimitSeconds = 0;
+    long long nodeBudget = 0;        //search nodes, or SAT decisions
+    long long propagationBudget = 0; //cells filled by the strategies, or SAT propagations
+};
+
+//why a solve stopped before it knew whether the board can be solved
+enum class StopReason {
+    None,
+    Deadline,
+    NodeBudget,
+    PropagationBudget,
+    Cancelled,
+    Undecided //every engine finished without a solution or a proof, e.g. the external solver failed
+};
+
+//Hashes of boards that have been proven to have no solution. A new entry overwrites whatever was in its slot,
+//so memory stays capped at the size picked up front. Slots are atomic so parallel workers can share a table.
+//A failed subtree only proves that the board has no completion in which every region holds a clue of the
+//puzzle being solved, and the domains narrowed above it rely on the same clues. So keys are the board hash
+//salted with the clue set (SolverContext::clueSalt): a puzzle with other clues never hits these entries.
+struct RefutationTable {
+    vector<atomic<uint64_t>> slots;
+    uint64_t mask;
+
+    explicit RefutationTable(size_t megabytes) {
+        size_t count = 1;
+        while (count * 2 * sizeof(uint64_t) <= megabytes << 20) {
+            count *= 2;
+        }
+        slots = vector<atomic<uint64_t>>(count);
+        mask = count - 1;
     }
 
-    std::string ln;
-    if (!std::getline(file, ln)) {
-        std::cout << "error reading the file" << std::endl;
-        return false;
+    //0 marks an empty slot, so the hash always gets its lowest bit set
+    bool contains(uint64_t hash) const {
+        hash |= 1;
+        return slots[hash & mask].load(memory_order_relaxed) == hash;
     }
-    if (ln.substr(0, 3) != "sat") {
-        std::cout << "No solution"<< std::endl;
-        return false;
+
+    void insert(uint64_t hash) {
+        hash |= 1;
+        slots[hash & mask].store(hash, memory_order_relaxed);
     }
+};
 
-    std::string line;
-    std::regex pattern(R"(\(\(n_(\d+) (\d+)\)\))");
+typedef vector<pair<int, int>> DecisionPath; //(cell, number) branches taken from the root of the search
 
-    while (std::getline(file, line)) {
-        std::smatch matches;
-        if (std::regex_match(line, matches, pattern)) {
-            int cellIndex = std::stoi(matches[1].str());
-            int number = std::stoi(matches[2].str());
+struct WorkDeque {
+    mutex lock;
+    deque<DecisionPath> tasks; //the owner works at the back, thieves take the oldest (biggest) subtrees at the front
+};
 
-            int row = cellIndex / Width;
-            int col = cellIndex % Width;
+//Shared by the workers of solveInParallel. A task is a subtree, given by the branches that lead to it.
+struct ParallelSearch {
+    vector<WorkDeque> deques;
+    atomic<int> idleWorkers{0};
+    atomic<long long> pendingTasks{0}; //pushed but not finished yet
+    atomic<bool> stop{false};          //set by the worker that found a solution
+    atomic<long long> solutionsFound{0}; //by all workers, when counting
 
-            if (row >= 0 && row < Height && col >= 0 && col < Width) {
-                board[row][col] = number;
-            }
-        }
-    }
+    mutex resultLock;
+    bool solved = false;
+    Board solution;
 
-    file.close();
-    return true;
-}
+    int maxSplitDepth = 64;
 
-bool allGroupsAreExactlyFilled() {
-    for (const auto& group : globalGroups) {
-        if (group.cells.size() != group.number) {
-            return false;
-        }
+    explicit ParallelSearch(int workers) : deques(workers) {}
+
+    //only give work away when someone is waiting for it
+    bool hungry() const { return idleWorkers.load(memory_order_relaxed) > 0; }
+
+    void push(int worker, DecisionPath path) {
+        pendingTasks++;
+        lock_guard<mutex> guard(deques[worker].lock);
+        deques[worker].tasks.push_back(move(path));
     }
-    return true;
-}
 
-// Check if a cell is within the board
-bool isValid(int i, int j) {
-    return (i >= 0 && i < Height && j >= 0 && j < Width);
-}
+    bool pop(int worker, DecisionPath& path) {
+        lock_guard<mutex> guard(deques[worker].lock);
+        if (deques[worker].tasks.empty()) return false;
+        path = move(deques[worker].tasks.back());
+        deques[worker].tasks.pop_back();
+        return true;
+    }
 
-bool existsOverfilledGroup() {
-    for (const auto& group : globalGroups) {
-        if (group.cells.size() > group.number) {
-            return true;
+    bool steal(int thief, DecisionPath& path) {
+        for (size_t k = 1; k < deques.size(); k++) {
+            WorkDeque& victim = deques[(thief + k) % deques.size()];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                path = move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
         }
+        return false;
     }
-    return false;
-}
+};
 
-void displayBoard() {
-    cout << "Board Layout:" << endl;
-    for (int i = 0; i < Height; i++) {
-        for (int j = 0; j < Width; j++) {
-            cout << board[i][j] << " ";
+//Scratch space of the BFS kernels, sized with the board and reused by every call, so a BFS does not touch
+//the heap. A cell counts as visited while its stamp equals the generation: starting a BFS bumps the
+//generation instead of clearing the array. Every cell enters the queue at most once per BFS, so a ring of
+//board size never overflows.
+struct BfsScratch {
+    vector<uint32_t> stamps;
+    uint32_t generation = 0;
+    vector<int> ring;
+    size_t mask = 0;
+    size_t head = 0; //pops so far, the ring index is taken with mask
+    size_t tail = 0; //pushes so far
+
+    void resize(size_t cells) {
+        size_t capacity = 1;
+        while (capacity < cells) capacity *= 2;
+        if (stamps.size() == cells && ring.size() == capacity) return;
+        stamps.assign(cells, 0);
+        generation = 0;
+        ring.assign(capacity, 0);
+        mask = capacity - 1;
+    }
+
+    void start() {
+        if (++generation == 0) {
+            fill(stamps.begin(), stamps.end(), 0);
+            generation = 1;
         }
-        cout << endl;
+        head = tail = 0;
     }
-    cout << endl;
-}
 
-// Find the size of a group of a given number
-int getGroupSize(int startRow, int startCol, int number) {
-    std::vector<std::vector<bool>> visited(Height, std::vector<bool>(Width, false));
-    queue<pair<int, int>> q;
-    int groupSize = 0;
+    bool seen(int cell) const { return stamps[cell] == generation; }
+    void mark(int cell) { stamps[cell] = generation; }
+
+    bool empty() const { return head == tail; }
+    void push(int cell) { ring[tail++ & mask] = cell; }
+    int pop() { return ring[head++ & mask]; }
+};
 
-    q.push({startRow, startCol});
-    visited[startRow][startCol] = true;
+//What the adaptive schedule knows about one deduction strategy on the recent boards of one size. Time and
+//fills are halved with every new board, so older boards count less.
+struct StrategyRecord {
+    static const int IDLE_RUNS_BEFORE_SKIPPING = 32;
+    static const int PROBE_INTERVAL = 8; //an idle strategy still runs once in this many times
 
-    while (!q.empty()) {
-        auto [row, col] = q.front();
-        q.pop();
-        groupSize++;
+    double ns = 0;
+    double deductions = 0; //cells filled
+    int idleRuns = 0;      //runs in a row that filled nothing
+    int skips = 0;         //runs skipped since the last probe
 
-        for (const auto& dir : DIRECTIONS) {
-            int newRow = row + dir[0];
-            int newCol = col + dir[1];
+    double costPerDeduction() const { return ns / (deductions + 1); }
 
-            if (isValid(newRow, newCol) && !visited[newRow][newCol] && board[newRow][newCol] == number) {
-                visited[newRow][newCol] = true;
-                q.push({newRow, newCol});
-            }
-        }
+    //true when the strategy can be left out this time
+    bool skip() {
+        if (idleRuns < IDLE_RUNS_BEFORE_SKIPPING) return false;
+        if (++skips < PROBE_INTERVAL) return true;
+        skips = 0;
+        return false;
     }
 
-    return groupSize;
-}
+    void ran(long long runNs, long long filled) {
+        ns += runNs;
+        deductions += filled;
+        idleRuns = filled > 0 ? 0 : idleRuns + 1;
+    }
+};
 
-// Check if we can reach the target cell from any number considering group size
-bool canReach(int startRow, int startCol, int targetRow, int targetCol, int number) {
-    if (board[startRow][startCol] == 0){
-        return false;
+//The records of all strategies for boards of height x width, kept by a context from puzzle to puzzle
+struct StrategyScheduler {
+    int height = 0;
+    int width = 0;
+    vector<StrategyRecord> records;
+    vector<int> order; //strategies by cost per deduction, ties in table order
+
+    void reset(int h, int w, int strategies) {
+        height = h;
+        width = w;
+        records.assign(strategies, StrategyRecord());
+        order.resize(strategies);
+        iota(order.begin(), order.end(), 0);
     }
 
-    int groupSize = getGroupSize(startRow, startCol, number);
-    int allowedMoves = number - groupSize;
+    //a new board: a new size starts over, the same size keeps half the weight
+    void newBoard(int h, int w) {
+        if (h != height || w != width) {
+            reset(h, w, records.size());
+            return;
+        }
+        for (StrategyRecord& record : records) {
+            record.ns /= 2;
+            record.deductions /= 2;
+        }
+    }
 
-    if (allowedMoves < 0){
-        return false;
+    void reorder() {
+        //insertion sort, there are only a few strategies and order is usually sorted already
+        for (size_t k = 1; k < order.size(); k++) {
+            for (size_t m = k; m > 0; m--) {
+                if (records[order[m - 1]].costPerDeduction() <= records[order[m]].costPerDeduction()) break;
+                swap(order[m], order[m - 1]);
+            }
+        }
     }
+};
+
+struct BoardKernels;
+
+//All state of one solve. Every solve gets its own context, so puzzles can be solved in parallel.
+struct SolverContext {
+    int Height = 10;
+    int Width = 10;
+    int maxNumOnBoard = DEFAULT_MAX_NUM;
+    Board board{Height, Width};
+    GroupTracker groups;
+    vector<tuple<int, int, int>> fixedCells; //For sat solver
+    uint64_t clueSalt = 0; //hash of the dimensions and fixedCells, part of the refutation table keys
+
+    //the different numbers on the board get a bit each, so sets of numbers fit in a NumberMask
+    int numberSlot[256];
+    vector<int> slotNumbers;
+    vector<NumberMask> reach; //per empty cell, the numbers whose groups can still reach it
+    vector<NumberMask> domains; //per empty cell, the numbers it can still get. Only ever narrowed while filling
+    vector<pair<int, NumberMask>> domainTrail; //old domains, so narrowing can be undone
+    BfsScratch scratch; //for computeReachability and canGroupBeCompleted, sized by findAndStoreGroups
+    deque<vector<int>> branchBuffers; //numbers to try per search depth, a deque keeps them in place as it grows
+    //Bitboards of the flood kernels, sized by findAndStoreGroups. A flood only works on the rows around its
+    //group, they are all 0 again when it returns. The cell bitboards are kept by groups.
+    BitGrid floodGrid, floodNext;
+    long long kernelMismatches = 0; //with FloodKernel::Check
+    const BoardKernels* kernels = nullptr; //instances for the board size, picked by findAndStoreGroups
+    StrategyScheduler scheduler; //for applyAllDeterministicFilling
+
+    SolveOptions options;
+    DecisionPath decisions;           //branches taken by solveWithBacktracking to the current node
+    ParallelSearch* search = nullptr; //set for the workers of solveInParallel
+    int workerId = 0;
+    long long tasksGivenAway = 0;
+    shared_ptr<RefutationTable> refuted; //created by the first search that needs it, shared with parallel workers
+
+    //Limits, checked in the search and filling loops. On a stop the board keeps what was filled before the
+    //first branch, every branch below it is undone.
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max(); //set by solve()
+    const atomic<bool>* cancel = nullptr; //another thread can set it to stop the solve
+    StopReason stopReason = StopReason::None;
+    long long propagations = 0; //cells filled by fillCell
+    const char* answeredBy = ""; //which side of the portfolio found the solution
+    vector<Cell> modelBackup; //the board applySMTmodel puts back when a model is rejected
+
+    //Above 0 only full boards count as solutions and the search keeps going until it has seen this many,
+    //see countSolutions()
+    long long solutionLimit = 0;
+    long long solutionsFound = 0;
+
+    int maxDepth = 0;
+    long long nodes = 0; //calls of solveWithBacktracking, or SAT decisions
+    SolveStats stats;
+    long long refutedHits = 0;
+    long long refutedMisses = 0;
+    std::map<int, int> depthGapHistogram;
+
+    SolverContext() { findAndStoreGroups(); }
+
+    bool loadSMTsolvedBoard(const std::string& filename);
+    const char* loadSMTmodel(const std::string& filename);
+    const char* applySMTmodel(const char* begin, const char* end);
+    bool verifySolution();
+    bool allGroupsAreExactlyFilled();
+    bool isValid(int i, int j);
+    bool existsOverfilledGroup();
+    void displayBoard();
+    int getGroupSize(int cell);
+    bool addNumberSlot(int number);
+    bool maskHasNumber(NumberMask mask, int number) const;
+    NumberMask numberBit(int number) const;
+    int singleNumber(NumberMask mask) const;
+    void computeReachability();
+    template <class Shape> void reachPass(bool bitboard);
+    void groupGrid(int root, BitGrid& grid, int& top, int& bottom);
+    bool canGroupBeCompletedByFlood(int root);
+    void narrowDomainsByReach();
+    void restrictDomain(int cell, NumberMask allowed);
+    TrailMark trailMark() const;
+    void undoTo(const TrailMark& mark);
+    bool existsEmptyDomain();
+    void findAndStoreGroups();
+    int checkReachability(int targetRow, int targetCol);
+    int checkIfEmptyCellCanBeReachedByOneNum(pair<int, int> &whichCell);
+    int checkSingleExitGroups(pair<int, int> &exitCell);
+    int groupExit(int root);
+    bool fillCell(int i, int j, int num);
+    bool removeCell(int i, int j);
+    bool readBoardFromFile(const string& filename);
+    bool loadBoard(int height, int width, const Cell* cells);
+    bool sweepSingleExits();
+    bool sweepSingleReachableNumbers();
+    bool canGroupBeCompleted(int root);
+    template <class Shape> bool canGroupBeCompletedIn(int root);
+    void checkIncompleteGroups();
+    bool canAllGroupsBeCompleted();
+    template <class Shape> bool canAllGroupsBeCompletedIn();
+    int findDefinitiveNumber(pair<int, int> &defCell);
+    int definitiveNumber(int cell);
+    bool sweepDefinitiveNumbers();
+    void applyAllDeterministicFilling();
+    int neighbourSlack(int cell, int number);
+    int chooseBranchCell();
+    void branchNumbers(int cell, vector<int>& numbers);
+    RefutationTable* refutationTable();
+    bool solveWithBacktracking(int currentDepth = 0);
+    bool searchNode(int currentDepth);
+    bool solveInParallel(int threads);
+    bool solveWithSat(int threads = 1);
+    bool countWithSatInParallel(int threads, const vector<tuple<int, int, int>>& clues);
+    bool solvePortfolio();
+    long long countSolutions(long long limit, int threads = 1);
+    bool solve(int threads = 1);
+    bool shouldStop(bool readClock = true);
+    const char* statusName(bool solved) const;
+    void resetStats();
+    void fillSingleExitCellsAndSafeMoves();
+    vector<int> completedGroupCells();
+};
 
-    std::vector<std::vector<bool>> visited(Height, std::vector<bool>(Width, false));
+//The hot kernels of SolverContext instantiated for one board shape. Height and width are 0 for the generic
+//instances that take any size.
+struct BoardKernels {
+    int height;
+    int width;
+    void (SolverContext::*reachPass)(bool bitboard);
+    bool (SolverContext::*canGroupBeCompleted)(int root);
+    bool (SolverContext::*canAllGroupsBeCompleted)();
+};
 
-    queue<pair<pair<int, int>, int>> q;
+const BoardKernels& boardKernels(int height, int width, bool specialized = true);
 
-    q.push({{startRow, startCol}, 0});
-    visited[startRow][startCol] = true;
+//One deduction rule of applyAllDeterministicFilling, see DEDUCTION_STRATEGIES
+struct DeductionStrategy {
+    const char* name;
+    bool (SolverContext::*sweep)();
+};
 
-    while (!q.empty()) {
-        auto front = q.front();
-        q.pop();
 
-        int row = front.first.first;
-        int col = front.first.second;
-        int moves = front.second;
+//Buffered output for the SMT emitter. Writes to a FILE* (a file, stdout or a pipe to a solver) in large
+//chunks, or appends to a string, so a formula never has to be held in memory as a whole. Without either
+//it only counts the bytes.
+class SmtWriter {
+public:
+    size_t bytes = 0; //everything written so far
 
-        if (row == targetRow && col == targetCol) return true;
+    SmtWriter() { buffer.reserve(BUFFER_SIZE); }
+    explicit SmtWriter(FILE* file) : file(file) { buffer.reserve(BUFFER_SIZE); }
+    explicit SmtWriter(string* text) : text(text) { buffer.reserve(BUFFER_SIZE); }
+    ~SmtWriter() { flush(); }
 
-        if (moves >= allowedMoves) continue;
+    SmtWriter& operator<<(const char* s) {
+        buffer.append(s);
+        if (buffer.size() >= BUFFER_SIZE) flush();
+        return *this;
+    }
 
-        for (const auto& dir : DIRECTIONS) {
-            int newRow = row + dir[0];
-            int newCol = col + dir[1];
+    SmtWriter& operator<<(int value) {
+        char digits[12];
+        char* end = digits + sizeof(digits);
+        char* p = end;
+        unsigned int v = value < 0 ? 0u - (unsigned int)value : value;
+        do {
+            *--p = '0' + v % 10;
+            v /= 10;
+        } while (v > 0);
+        if (value < 0) *--p = '-';
+        buffer.append(p, end);
+        return *this;
+    }
 
-            if (isValid(newRow, newCol) && !visited[newRow][newCol] && board[newRow][newCol] == 0) {
-                visited[newRow][newCol] = true;
-                q.push({{newRow, newCol}, moves + 1});
-            }
+    //false if writing to the file failed
+    bool flush() {
+        bytes += buffer.size();
+        if (text) {
+            text->append(buffer);
+        } else if (file && !buffer.empty() && fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+            failed = true;
         }
+        buffer.clear();
+        return !failed;
     }
 
-    return false;
-}
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 16;
+    FILE* file = nullptr;
+    string* text = nullptr;
+    string buffer;
+    bool failed = false;
+};
 
-//find groups in the board and store them
-void findAndStoreGroups() {
-    globalGroups.clear();
-    std::vector<std::vector<bool>> visited(Height, std::vector<bool>(Width, false));
+class FillominoSMTSolver {
+public:
+    int rows, cols;
+    vector<int> neighborStart; //neighbors of cell x are neighborList[neighborStart[x] .. neighborStart[x + 1])
+    vector<int> neighborList;
+    vector<int> closed; //per cell, the number of the completed group it is in, 0 for open cells
 
+    FillominoSMTSolver() {}
 
-    for (int i = 0; i < Height; i++) {
-        for (int j = 0; j < Width; j++) {
-            if (board[i][j] != 0 && !visited[i][j]) {
-                //BFS to find group
-                queue<pair<int, int>> q;
-                vector<pair<int, int>> groupCells;
-                int number = board[i][j];
-
-                q.push({i, j});
-                visited[i][j] = true;
-
-                while (!q.empty()) {
-                    auto [row, col] = q.front();
-                    q.pop();
-                    groupCells.push_back({row, col});
-
-                    for (const auto& dir : DIRECTIONS) {
-                        int newRow = row + dir[0];
-                        int newCol = col + dir[1];
-
-                        if (isValid(newRow, newCol) && !visited[newRow][newCol] && board[newRow][newCol] == number) {
-                            visited[newRow][newCol] = true;
-                            q.push({newRow, newCol});
-                        }
-                    }
-                }
+    bool isOpen(int x) const { return closed.empty() || closed[x] == 0; }
 
-                //store into global var
-                Group newGroup = {number, groupCells};
-                globalGroups.push_back(newGroup);
+    //open neighbours only, in the same order as the old per-cell adj(): up, down, left, right
+    void buildNeighbors() {
+        neighborStart.assign(1, 0);
+        neighborList.clear();
+        for (int row = 0; row < rows; row++) {
+            for (int col = 0; col < cols; col++) {
+                int x = row * cols + col;
+                if (isOpen(x)) {
+                    if (row - 1 >= 0 && isOpen(x - cols)) neighborList.push_back(x - cols);
+                    if (row + 1 < rows && isOpen(x + cols)) neighborList.push_back(x + cols);
+                    if (col - 1 >= 0 && isOpen(x - 1)) neighborList.push_back(x - 1);
+                    if (col + 1 < cols && isOpen(x + 1)) neighborList.push_back(x + 1);
+                }
+                neighborStart.push_back(neighborList.size());
             }
         }
     }
-}
 
-//Checks if this cell can be reached by exactly 1 number
-int checkReachability(int targetRow, int targetCol) {
+    string solve(int r, int c, const vector<tuple<int, int, int>>& nums) {
+        string text;
+        {
+            SmtWriter out(&text);
+            write(out, r, c, nums);
+        }
+        return text;
+    }
 
-    bool found = false;
-    int howManyNumsCanReachThis = 0;
-    int lastNumberThatReached = -1;
+    //closedCells (optional) marks the completed groups of a partly solved board. Their cells get constant
+    //numbers and no edge, size or root variables, only their open neighbours are kept from joining them.
+    void write(SmtWriter& out, int r, int c, const vector<tuple<int, int, int>>& nums,
+               const vector<int>& closedCells = {}) {
+        out << "(set-option :print-success false)\n";
+        out << "(set-logic QF_UFLIA)\n";
 
-    for (int number = 2; number <= maxNumOnBoard; number++) {
-        bool reachable = false;
+        rows = r;
+        cols = c;
+        closed = closedCells;
+        buildNeighbors();
+        int cells = rows * cols;
 
-        for (int i = 0; i < Height; i++) {
-            for (int j = 0; j < Width; j++) {
-                if (board[i][j] == number) {
-                    if (canReach(i, j, targetRow, targetCol, number)) {
-                        reachable = true;
-                        break;
-                    }
-                }
+		//we define edges e_{x}_{y} between cells. 1 if there exists one between two cells, else 0
+        for (int x = 0; x < cells; x++) {
+            for (int k = neighborStart[x]; k < neighborStart[x + 1]; k++) {
+                int y = neighborList[k];
+                out << "(declare-fun e_" << x << "_" << y << " () Int)\n";
+                out << "(assert (or (= e_" << x << "_" << y << " 0) (= e_" << x << "_" << y << " 1)))\n";
             }
-            if (reachable) break;
         }
 
-        if (reachable) {
-            lastNumberThatReached = number;
-            howManyNumsCanReachThis++;
+		//We cant have an edge between cells in both directions, only one direction.
+        for (int x = 0; x < cells; x++) {
+            for (int k = neighborStart[x]; k < neighborStart[x + 1]; k++) {
+                int y = neighborList[k];
+                out << "(assert (<= (+ e_" << x << "_" << y << " e_" << y << "_" << x << ") 1))\n";
+            }
+        }
 
-            if(howManyNumsCanReachThis > 1){
-                //More than 1 number can reach this cell
-                return -1;
+		//each cell is allowed to have at most one incoming edge (tree structure)
+        for (int x = 0; x < cells; x++) {
+            if (!isOpen(x)) continue;
+            out << "(assert (<= (+\n";
+            for (int k = neighborStart[x]; k < neighborStart[x + 1]; k++) {
+                out << "               e_" << neighborList[k] << "_" << x << "\n";
             }
+            out << ") 1))\n";
         }
-    }
 
-    if (howManyNumsCanReachThis == 0) {
-        //No number can reach the empty cell
-        return 0;
-    }
-    else{
-        //The only number that could reach the cell
-        return lastNumberThatReached;
-    }
-}
+		//number variable for each cell, a constant for cells in completed groups
+        for (int x = 0; x < cells; x++) {
+            if (isOpen(x)) out << "(declare-fun n_" << x << " () Int)\n";
+            else out << "(define-fun n_" << x << " () Int " << closed[x] << ")\n";
+        }
 
-int checkIfEmptyCellCanBeReachedByOneNum(pair<int, int> &whichCell){
-    //Checks if there is an empty cell on the board that can be reached by only one number
-    whichCell = {-1, -1};
-    for (int i = 0; i < Height; i++){
-        for(int j = 0; j < Width; j++){
-            if (isValid(i, j) && board[i][j] == 0){
-                int ReachableCode = checkReachability(i,j);
-                if(ReachableCode > 0){
-                    //Empty cell as parameter, and which number it only can be reached by, will be returned
-                    whichCell = {i, j};
-                    return ReachableCode;
+		//If we already know if certain cells contain a certain number, we assign them.
+        for (auto [i, j, k] : nums) {
+            if (isOpen(i * cols + j)) out << "(assert (= n_" << i * cols + j << " " << k << "))\n";
+        }
+
+		//an open cell next to a completed group can not have its number, the group would grow
+        for (int x = 0; x < cells && !closed.empty(); x++) {
+            if (!isOpen(x)) continue;
+            int row = x / cols, col = x % cols;
+            int touching[4], count = 0;
+            if (row - 1 >= 0) touching[count++] = x - cols;
+            if (row + 1 < rows) touching[count++] = x + cols;
+            if (col - 1 >= 0) touching[count++] = x - 1;
+            if (col + 1 < cols) touching[count++] = x + 1;
+            for (int k = 0; k < count; k++) {
+                int number = closed[touching[k]];
+                bool repeated = false;
+                for (int m = 0; m < k; m++) {
+                    repeated |= closed[touching[m]] == number;
                 }
+                if (number != 0 && !repeated) out << "(assert (not (= n_" << x << " " << number << ")))\n";
+            }
+        }
+
+		//size constraint for regions
+        for (int x = 0; x < cells; x++) {
+            if (isOpen(x)) out << "(declare-fun s_" << x << " () Int)\n";
+        }
 
+		//s_x =  (sum of the sizes of the neighbours connected from this cell) + 1.
+        for (int x = 0; x < cells; x++) {
+            if (!isOpen(x)) continue;
+            out << "(assert (= s_" << x << " (+ 1\n";
+            for (int k = neighborStart[x]; k < neighborStart[x + 1]; k++) {
+                int y = neighborList[k];
+                out << "                   (ite (= e_" << x << "_" << y << " 1) s_" << y << " 0)\n";
             }
+            out << ")))\n";
         }
-    }
 
-    //No empty cell on the board can be reached by exactly 1 number.
-    return -1;
-}
+		//if there are no incoming edges, s_x has to equal n_x
+        for (int x = 0; x < cells; x++) {
+            if (!isOpen(x)) continue;
+            out << "(assert (=> (= (+\n";
+            for (int k = neighborStart[x]; k < neighborStart[x + 1]; k++) {
+                out << "                  e_" << neighborList[k] << "_" << x << "\n";
+            }
+            out << ") 0) (= s_" << x << " n_" << x << ")))\n";
+        }
 
-//If we found a group that isnt full with one exit, we store the exit cell in the parameter and return the number.
-int checkSingleExitGroups(pair<int, int> &exitCell) {
-    findAndStoreGroups();
-    for (const auto& group : globalGroups) {
-        int exitCount = 0;
-        pair<int, int> tempExit = {-1, -1};
-
-        // Loop through each cell in the group to count exits
-        for (const auto& cell : group.cells) {
-            int row = cell.first;
-            int col = cell.second;
-
-            //check the 4 directions
-            for (const auto& dir : DIRECTIONS) {
-                int newRow = row + dir[0];
-                int newCol = col + dir[1];
-
-                //check if cell is valid
-                if (isValid(newRow, newCol) && board[newRow][newCol] == 0 && exitCell == make_pair(-1, -1)) {
-                    exitCount++;
-                    tempExit = {newRow, newCol};
-                    if(exitCount > 1){
-                        break;
-                    }
-                }
+		//all cells in the same region must have the same number
+        for (int x = 0; x < cells; x++) {
+            for (int k = neighborStart[x]; k < neighborStart[x + 1]; k++) {
+                int y = neighborList[k];
+                out << "(assert (=> (= e_" << x << "_" << y << " 1) (= n_" << x << " n_" << y << ")))\n";
             }
-            if(exitCount > 1){
-                    break;
+        }
+
+		//declare root variable for each cell
+        for (int x = 0; x < cells; x++) {
+            if (isOpen(x)) out << "(declare-fun r_" << x << " () Int)\n";
+        }
+
+		//cells with no incoming edges are roots.
+        for (int x = 0; x < cells; x++) {
+            if (!isOpen(x)) continue;
+            out << "(assert (=> (= (+\n";
+            for (int k = neighborStart[x]; k < neighborStart[x + 1]; k++) {
+                out << "                  e_" << neighborList[k] << "_" << x << "\n";
             }
+            out << ") 0) (= r_" << x << " " << x << ")))\n";
         }
 
-        //exactly one exit found
-        if (exitCount == 1 && group.cells.size() < group.number) {
-            exitCell = tempExit;
-            return group.number;
+		//connected cells in the same region, must have the same root.
+        for (int x = 0; x < cells; x++) {
+            for (int k = neighborStart[x]; k < neighborStart[x + 1]; k++) {
+                int y = neighborList[k];
+                out << "(assert (=> (= n_" << x << " n_" << y << ") (= r_" << x << " r_" << y << ")))\n";
+            }
         }
-    }
 
-    //no group found with exactly one exit
-    return -1;
-}
+        out << "(check-sat)\n";
 
-bool fillCell(int i, int j, int num) {
-    if (!isValid(i, j) || board[i][j] != 0 || num < 2 || num > maxNumOnBoard) {
-        return false; 
+        for (int x = 0; x < cells; x++) {
+            out << "(get-value (n_" << x << "))\n";
+        }
+    }
+};
+
+
+//Small CDCL SAT solver: two watched literals, VSIDS with phase saving, first-UIP learning with clause
+//minimization, Luby restarts and periodic removal of inactive learnt clauses. A literal is 2 * var + sign.
+//Clauses can be added between solve() calls, learnt clauses are kept, so it can be used incrementally.
+class SatSolver {
+public:
+    long long conflicts = 0;
+    long long decisions = 0;
+    long long propagations = 0;
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max();
+    const atomic<bool>* cancel = nullptr;
+    long long decisionBudget = 0;    //0 for none
+    long long propagationBudget = 0; //0 for none
+    StopReason stopReason = StopReason::None; //why the last solve() returned -1, None for the conflict budget
+    //Literals solve() takes as true before any decision. 0 then only means no solution under them, the
+    //clauses (and everything learnt from them) stay for the next call with other assumptions.
+    vector<int> assumptions;
+
+    static int lit(int var, bool negated = false) { return 2 * var + negated; }
+
+    int newVar() {
+        int var = values.size();
+        values.push_back(UNDEF);
+        levels.push_back(0);
+        reasons.push_back(-1);
+        activity.push_back(0);
+        phases.push_back(1);
+        seen.push_back(0);
+        heapIndex.push_back(-1);
+        watches.emplace_back();
+        watches.emplace_back();
+        heapInsert(var);
+        return var;
+    }
+
+    int varCount() const { return values.size(); }
+
+    //false once the clauses can no longer be satisfied
+    bool addClause(vector<int> lits) {
+        if (!ok) return false;
+        cancelUntil(0);
+
+        sort(lits.begin(), lits.end());
+        size_t kept = 0;
+        for (size_t k = 0; k < lits.size(); k++) {
+            int l = lits[k];
+            if (litValue(l) == TRUE || (k > 0 && l == (lits[k - 1] ^ 1))) return true; //satisfied
+            if (litValue(l) == FALSE || (k > 0 && l == lits[k - 1])) continue;
+            lits[kept++] = l;
+        }
+        lits.resize(kept);
+
+        if (lits.empty()) {
+            ok = false;
+        } else if (lits.size() == 1) {
+            enqueue(lits[0], -1);
+            ok = propagate() < 0;
+        } else {
+            attach(newClause(move(lits), false));
+        }
+        return ok;
+    }
+
+    //1 satisfiable (see modelValue), 0 unsatisfiable, -1 conflict budget used up or another limit reached
+    int solve(long long conflictBudget = -1) {
+        stopReason = StopReason::None;
+        if (!ok) return 0;
+        long long budgetEnd = conflictBudget < 0 ? LLONG_MAX : conflicts + conflictBudget;
+        int restart = 0;
+
+        while (true) {
+            long long restartEnd = conflicts + 100 * luby(restart++);
+            int status = search(restartEnd, budgetEnd);
+            if (status != -1) return status;
+            if (conflicts >= budgetEnd || stopReason != StopReason::None) return -1;
+        }
+    }
+
+    bool modelValue(int var) const { return model[var]; }
+
+private:
+    static constexpr signed char UNDEF = -1, FALSE = 0, TRUE = 1;
+
+    struct Clause {
+        vector<int> lits;
+        bool learnt;
+        bool deleted;
+        double activity;
+    };
+
+    bool ok = true;
+    vector<Clause> clauses;
+    vector<vector<int>> watches; //per literal, the clauses watching its negation
+    vector<signed char> values;
+    vector<int> levels;
+    vector<int> reasons;
+    vector<int> trail;
+    vector<int> trailLimits;
+    size_t propagateHead = 0;
+    vector<char> model;
+
+    vector<double> activity;
+    double varIncrement = 1;
+    double clauseIncrement = 1;
+    vector<char> phases;
+    vector<int> heap;
+    vector<int> heapIndex;
+    vector<char> seen;
+
+    size_t learntCount = 0;
+    double maxLearnts = 0;
+    long long deadlineChecked = 0;
+
+    signed char litValue(int l) const {
+        signed char v = values[l >> 1];
+        return v == UNDEF ? UNDEF : v ^ (l & 1);
+    }
+
+    int decisionLevel() const { return trailLimits.size(); }
+
+    //sets stopReason, the clock is only read every 256 conflicts
+    bool limitReached() {
+        if (cancel && cancel->load(memory_order_relaxed)) {
+            stopReason = StopReason::Cancelled;
+        } else if (decisionBudget > 0 && decisions >= decisionBudget) {
+            stopReason = StopReason::NodeBudget;
+        } else if (propagationBudget > 0 && propagations >= propagationBudget) {
+            stopReason = StopReason::PropagationBudget;
+        } else if (conflicts - deadlineChecked >= 256) {
+            deadlineChecked = conflicts;
+            if (chrono::steady_clock::now() > deadline) stopReason = StopReason::Deadline;
+        }
+        return stopReason != StopReason::None;
+    }
+
+    static long long luby(int x) {
+        long long size = 1;
+        int seq = 0;
+        while (size < x + 1) {
+            seq++;
+            size = 2 * size + 1;
+        }
+        while (size - 1 != x) {
+            size = (size - 1) >> 1;
+            seq--;
+            x = x % size;
+        }
+        return 1LL << seq;
+    }
+
+    int newClause(vector<int> lits, bool learnt) {
+        clauses.push_back({move(lits), learnt, false, 0});
+        if (learnt) learntCount++;
+        return clauses.size() - 1;
+    }
+
+    void attach(int index) {
+        const vector<int>& lits = clauses[index].lits;
+        watches[lits[0] ^ 1].push_back(index);
+        watches[lits[1] ^ 1].push_back(index);
+    }
+
+    void enqueue(int l, int reason) {
+        int var = l >> 1;
+        values[var] = !(l & 1);
+        levels[var] = decisionLevel();
+        reasons[var] = reason;
+        trail.push_back(l);
+    }
+
+    void cancelUntil(int level) {
+        if (decisionLevel() <= level) return;
+        for (size_t k = trail.size(); k > (size_t)trailLimits[level]; k--) {
+            int var = trail[k - 1] >> 1;
+            phases[var] = values[var];
+            values[var] = UNDEF;
+            reasons[var] = -1;
+            if (heapIndex[var] < 0) heapInsert(var);
+        }
+        trail.resize(trailLimits[level]);
+        trailLimits.resize(level);
+        propagateHead = trail.size();
+    }
+
+    //returns the conflicting clause or -1
+    int propagate() {
+        while (propagateHead < trail.size()) {
+            int p = trail[propagateHead++];
+            int falseLit = p ^ 1;
+            vector<int>& ws = watches[p];
+            propagations++;
+
+            size_t i = 0, j = 0;
+            while (i < ws.size()) {
+                int index = ws[i++];
+                Clause& c = clauses[index];
+                if (c.deleted) continue;
+
+                if (c.lits[0] == falseLit) swap(c.lits[0], c.lits[1]);
+                if (litValue(c.lits[0]) == TRUE) {
+                    ws[j++] = index;
+                    continue;
+                }
+
+                bool moved = false;
+                for (size_t k = 2; k < c.lits.size(); k++) {
+                    if (litValue(c.lits[k]) != FALSE) {
+                        swap(c.lits[1], c.lits[k]);
+                        watches[c.lits[1] ^ 1].push_back(index);
+                        moved = true;
+                        break;
+                    }
+                }
+                if (moved) continue;
+
+                ws[j++] = index;
+                if (litValue(c.lits[0]) == FALSE) {
+                    while (i < ws.size()) ws[j++] = ws[i++];
+                    ws.resize(j);
+                    return index;
+                }
+                enqueue(c.lits[0], index);
+            }
+            ws.resize(j);
+        }
+        return -1;
+    }
+
+    //first-UIP clause for the conflict, lits[0] is the literal that gets asserted after backjumping
+    vector<int> analyze(int conflict, int& backtrackLevel) {
+        vector<int> learnt(1);
+        int pathCount = 0;
+        int p = -1;
+        size_t index = trail.size();
+
+        do {
+            Clause& c = clauses[conflict];
+            if (c.learnt) bumpClause(c);
+            for (size_t k = (p == -1 ? 0 : 1); k < c.lits.size(); k++) {
+                int q = c.lits[k];
+                int var = q >> 1;
+                if (!seen[var] && levels[var] > 0) {
+                    seen[var] = 1;
+                    bumpVar(var);
+                    if (levels[var] >= decisionLevel()) pathCount++;
+                    else learnt.push_back(q);
+                }
+            }
+            while (!seen[trail[--index] >> 1]) {}
+            p = trail[index];
+            conflict = reasons[p >> 1];
+            seen[p >> 1] = 0;
+            pathCount--;
+        } while (pathCount > 0);
+        learnt[0] = p ^ 1;
+
+        //drop literals implied by the rest of the clause
+        vector<int> toClear(learnt.begin(), learnt.end());
+        size_t kept = 1;
+        for (size_t k = 1; k < learnt.size(); k++) {
+            int reason = reasons[learnt[k] >> 1];
+            bool redundant = reason >= 0;
+            if (redundant) {
+                const vector<int>& lits = clauses[reason].lits;
+                for (size_t r = 1; r < lits.size(); r++) {
+                    int var = lits[r] >> 1;
+                    if (!seen[var] && levels[var] > 0) {
+                        redundant = false;
+                        break;
+                    }
+                }
+            }
+            if (!redundant) learnt[kept++] = learnt[k];
+        }
+        learnt.resize(kept);
+        for (int l : toClear) seen[l >> 1] = 0;
+
+        backtrackLevel = 0;
+        if (learnt.size() > 1) {
+            size_t maxIndex = 1;
+            for (size_t k = 2; k < learnt.size(); k++) {
+                if (levels[learnt[k] >> 1] > levels[learnt[maxIndex] >> 1]) maxIndex = k;
+            }
+            swap(learnt[1], learnt[maxIndex]);
+            backtrackLevel = levels[learnt[1] >> 1];
+        }
+        return learnt;
+    }
+
+    int search(long long restartEnd, long long budgetEnd) {
+        if (maxLearnts == 0) maxLearnts = max<double>(clauses.size() / 3.0, 2000);
+
+        while (true) {
+            int conflict = propagate();
+            if (conflict >= 0) {
+                conflicts++;
+                if (decisionLevel() == 0) {
+                    ok = false;
+                    return 0;
+                }
+                int backtrackLevel;
+                vector<int> learnt = analyze(conflict, backtrackLevel);
+                cancelUntil(backtrackLevel);
+                if (learnt.size() == 1) {
+                    enqueue(learnt[0], -1);
+                } else {
+                    int index = newClause(move(learnt), true);
+                    attach(index);
+                    bumpClause(clauses[index]);
+                    enqueue(clauses[index].lits[0], index);
+                }
+                varIncrement /= 0.95;
+                clauseIncrement /= 0.999;
+                continue;
+            }
+
+            if (conflicts >= restartEnd || conflicts >= budgetEnd || limitReached()) {
+                cancelUntil(0);
+                return -1;
+            }
+            if ((double)learntCount - (double)trail.size() >= maxLearnts) {
+                reduceLearnts();
+                maxLearnts *= 1.1;
+            }
+
+            //the assumptions are the first decisions, one level each
+            int next = -1;
+            while (next < 0 && decisionLevel() < (int)assumptions.size()) {
+                int l = assumptions[decisionLevel()];
+                if (litValue(l) == FALSE) {
+                    cancelUntil(0);
+                    return 0;
+                }
+                if (litValue(l) == TRUE) trailLimits.push_back(trail.size());
+                else next = l;
+            }
+            while (next < 0 && !heap.empty()) {
+                int var = heapPop();
+                if (values[var] == UNDEF) next = lit(var, !phases[var]);
+            }
+            if (next < 0) {
+                model.assign(values.begin(), values.end());
+                cancelUntil(0);
+                return 1;
+            }
+            decisions++;
+            trailLimits.push_back(trail.size());
+            enqueue(next, -1);
+        }
+    }
+
+    //throws away the less active half of the learnt clauses that are not reasons right now
+    void reduceLearnts() {
+        vector<int> candidates;
+        for (size_t index = 0; index < clauses.size(); index++) {
+            const Clause& c = clauses[index];
+            if (!c.learnt || c.deleted || c.lits.size() <= 2) continue;
+            int var = c.lits[0] >> 1;
+            bool locked = reasons[var] == (int)index && litValue(c.lits[0]) == TRUE;
+            if (!locked) candidates.push_back(index);
+        }
+        sort(candidates.begin(), candidates.end(), [&](int a, int b) {
+            return clauses[a].activity < clauses[b].activity;
+        });
+        for (size_t k = 0; k < candidates.size() / 2; k++) {
+            Clause& c = clauses[candidates[k]];
+            c.deleted = true;
+            c.lits.clear();
+            c.lits.shrink_to_fit();
+            learntCount--;
+        }
+    }
+
+    void bumpVar(int var) {
+        activity[var] += varIncrement;
+        if (activity[var] > 1e100) {
+            for (double& a : activity) a *= 1e-100;
+            varIncrement *= 1e-100;
+        }
+        if (heapIndex[var] >= 0) heapUp(heapIndex[var]);
+    }
+
+    void bumpClause(Clause& c) {
+        c.activity += clauseIncrement;
+        if (c.activity > 1e20) {
+            for (Clause& other : clauses) {
+                if (other.learnt) other.activity *= 1e-20;
+            }
+            clauseIncrement *= 1e-20;
+        }
+    }
+
+    //binary max-heap of variables ordered by activity
+    void heapInsert(int var) {
+        heapIndex[var] = heap.size();
+        heap.push_back(var);
+        heapUp(heap.size() - 1);
+    }
+
+    int heapPop() {
+        int top = heap[0];
+        heapIndex[top] = -1;
+        int last = heap.back();
+        heap.pop_back();
+        if (!heap.empty()) {
+            heap[0] = last;
+            heapIndex[last] = 0;
+            heapDown(0);
+        }
+        return top;
+    }
+
+    void heapUp(int pos) {
+        int var = heap[pos];
+        while (pos > 0) {
+            int parent = (pos - 1) / 2;
+            if (activity[heap[parent]] >= activity[var]) break;
+            heap[pos] = heap[parent];
+            heapIndex[heap[pos]] = pos;
+            pos = parent;
+        }
+        heap[pos] = var;
+        heapIndex[var] = pos;
+    }
+
+    void heapDown(int pos) {
+        int var = heap[pos];
+        while (true) {
+            int child = 2 * pos + 1;
+            if (child >= (int)heap.size()) break;
+            if (child + 1 < (int)heap.size() && activity[heap[child + 1]] > activity[heap[child]]) child++;
+            if (activity[heap[child]] <= activity[var]) break;
+            heap[pos] = heap[child];
+            heapIndex[heap[pos]] = pos;
+            pos = child;
+        }
+        heap[pos] = var;
+        heapIndex[var] = pos;
+    }
+};
+
+//Fillomino as pure SAT, solved in process. The SMT model's edges, sizes and roots need integer sums, which do
+//not encode compactly in CNF, so x(cell, n) ("the cell holds n") is used instead: every cell holds exactly one
+//number from 1..maxNumber and a cell with n > 1 has a neighbour with n. Region sizes are enforced lazily:
+//every model is checked, each region that is too big or too small gets a clause that rules it out, and the
+//solver continues with everything it learnt so far.
+class FillominoSatSolver {
+public:
+    int rows, cols, maxNumber;
+    long long refinements = 0;
+    SatSolver sat;
+
+    FillominoSatSolver() {}
+
+    int var(int cell, int number) const { return cell * maxNumber + number - 1; }
+
+    vector<int> adj(int cell) const {
+        int row = cell / cols, col = cell % cols;
+        vector<int> neighbors;
+        if (row - 1 >= 0) neighbors.push_back(cell - cols);
+        if (row + 1 < rows) neighbors.push_back(cell + cols);
+        if (col - 1 >= 0) neighbors.push_back(cell - 1);
+        if (col + 1 < cols) neighbors.push_back(cell + 1);
+        return neighbors;
+    }
+
+    //1 solved (numbers row by row in solution), 0 no solution, -1 conflict budget used up
+    int solve(int r, int c, int maxNum, const vector<tuple<int, int, int>>& nums, vector<int>& solution,
+              long long conflictBudget = -1) {
+        encode(r, c, maxNum);
+        for (auto [i, j, k] : nums) {
+            if (k < 1 || k > maxNumber) return 0;
+            sat.addClause({SatSolver::lit(var(i * cols + j, k))});
+        }
+        return next(solution, conflictBudget);
+    }
+
+    //the rules of an empty r x c board, clues are added by solve() or given to next() as assumptions
+    void encode(int r, int c, int maxNum) {
+        rows = r;
+        cols = c;
+        maxNumber = maxNum;
+        int cells = rows * cols;
+        for (int k = 0; k < cells * maxNumber; k++) {
+            sat.newVar();
+        }
+
+        for (int cell = 0; cell < cells; cell++) {
+            //exactly one number per cell
+            vector<int> oneOf;
+            for (int n = 1; n <= maxNumber; n++) {
+                oneOf.push_back(SatSolver::lit(var(cell, n)));
+            }
+            sat.addClause(oneOf);
+            addAtMostOne(oneOf);
+
+            for (int n = 1; n <= maxNumber; n++) {
+                vector<int> neighbors = adj(cell);
+                if (n == 1) {
+                    //two 1's can not touch
+                    for (int next : neighbors) {
+                        if (next > cell) sat.addClause({SatSolver::lit(var(cell, 1), true), SatSolver::lit(var(next, 1), true)});
+                    }
+                    continue;
+                }
+                //a bigger region continues into a neighbour
+                vector<int> clause = {SatSolver::lit(var(cell, n), true)};
+                for (int next : neighbors) {
+                    clause.push_back(SatSolver::lit(var(next, n)));
+                }
+                sat.addClause(clause);
+            }
+        }
+    }
+
+    //the literal of number n in cell (row by row), for sat.assumptions
+    int cellLit(int cell, int n, bool negated = false) const { return SatSolver::lit(var(cell, n), negated); }
+
+    //the next solution that block() has not ruled out yet, same results as solve()
+    int next(vector<int>& solution, long long conflictBudget = -1) {
+        int cells = rows * cols;
+        long long budgetEnd = conflictBudget < 0 ? -1 : sat.conflicts + conflictBudget;
+        while (true) {
+            long long budget = budgetEnd < 0 ? -1 : max(0LL, budgetEnd - sat.conflicts);
+            int status = sat.solve(budget);
+            if (status != 1) return status;
+
+            solution.assign(cells, 0);
+            for (int cell = 0; cell < cells; cell++) {
+                for (int n = 1; n <= maxNumber; n++) {
+                    if (sat.modelValue(var(cell, n))) solution[cell] = n;
+                }
+            }
+            if (!refineRegions(solution)) return 1;
+            refinements++;
+        }
+    }
+
+    //rules out one solution, so next() finds a different one
+    void block(const vector<int>& solution) {
+        vector<int> clause;
+        for (int cell = 0; cell < rows * cols; cell++) {
+            clause.push_back(SatSolver::lit(var(cell, solution[cell]), true));
+        }
+        sat.addClause(clause);
+    }
+
+private:
+    //sequential counter for long lists, pairwise for short ones
+    void addAtMostOne(const vector<int>& lits) {
+        if (lits.size() <= 6) {
+            for (size_t a = 0; a < lits.size(); a++) {
+                for (size_t b = a + 1; b < lits.size(); b++) {
+                    sat.addClause({lits[a] ^ 1, lits[b] ^ 1});
+                }
+            }
+            return;
+        }
+        int previous = -1;
+        for (size_t k = 0; k < lits.size(); k++) {
+            if (k + 1 < lits.size()) {
+                int counter = SatSolver::lit(sat.newVar());
+                sat.addClause({lits[k] ^ 1, counter});
+                if (previous >= 0) sat.addClause({previous ^ 1, counter});
+                if (previous >= 0) sat.addClause({lits[k] ^ 1, previous ^ 1});
+                previous = counter;
+            } else {
+                sat.addClause({lits[k] ^ 1, previous ^ 1});
+            }
+        }
+    }
+
+    //adds a clause for every region of the model with the wrong size, false if there was none
+    bool refineRegions(const vector<int>& solution) {
+        int cells = rows * cols;
+        vector<int> region(cells, -1);
+        bool refined = false;
+
+        for (int start = 0; start < cells; start++) {
+            if (region[start] >= 0) continue;
+            int n = solution[start];
+
+            vector<int> members = {start};
+            region[start] = start;
+            for (size_t head = 0; head < members.size(); head++) {
+                for (int next : adj(members[head])) {
+                    if (region[next] < 0 && solution[next] == n) {
+                        region[next] = start;
+                        members.push_back(next);
+                    }
+                }
+            }
+            if ((int)members.size() == n) continue;
+
+            vector<int> clause;
+            if ((int)members.size() > n) {
+                //the first n + 1 cells of the BFS are connected, they can not all hold n
+                for (int k = 0; k <= n; k++) {
+                    clause.push_back(SatSolver::lit(var(members[k], n), true));
+                }
+            } else {
+                //too small: one of the cells changes or the region grows into its border
+                vector<char> onBorder(cells, 0);
+                for (int cell : members) {
+                    clause.push_back(SatSolver::lit(var(cell, n), true));
+                    for (int next : adj(cell)) {
+                        if (region[next] != start && !onBorder[next]) {
+                            onBorder[next] = 1;
+                            clause.push_back(SatSolver::lit(var(next, n)));
+                        }
+                    }
+                }
+            }
+            sat.addClause(clause);
+            refined = true;
+        }
+        return refined;
+    }
+};
+
+
+//Reads the model part of z3/yices output: get-value lines ((n_X V)) or ((n_X V) (n_Y W) ...), get-model
+//entries (define-fun n_X () Int V) and yices' (= n_X V). Calls assign(X, V) for every n_ variable.
+//Returns 1 for sat, 0 for unsat/unknown and -1 if the text does not look like solver output.
+template <typename Assign>
+int parseSmtModel(const char* p, const char* end, Assign assign) {
+    auto isSpace = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+    auto isName = [](char c) { return isalnum((unsigned char)c) || c == '_' || c == '-'; };
+
+    while (p < end && isSpace(*p)) p++;
+    if (end - p >= 5 && strncmp(p, "unsat", 5) == 0) return 0;
+    if (end - p >= 7 && strncmp(p, "unknown", 7) == 0) return 0;
+    if (end - p < 3 || strncmp(p, "sat", 3) != 0) return -1;
+    p += 3;
+
+    const char* start = p;
+    while (p + 2 < end) {
+        if (p[0] != 'n' || p[1] != '_' || (p > start && isName(p[-1]))) {
+            p++;
+            continue;
+        }
+        p += 2;
+        long long cell = 0;
+        const char* digits = p;
+        while (p < end && isdigit((unsigned char)*p)) {
+            cell = min(cell * 10 + (*p++ - '0'), (long long)INT_MAX);
+        }
+        if (p == digits || (p < end && isName(*p))) continue;
+
+        //define-fun puts "() Int" between the name and the value
+        while (p < end && isSpace(*p)) p++;
+        if (end - p >= 2 && p[0] == '(' && p[1] == ')') {
+            p += 2;
+            while (p < end && isSpace(*p)) p++;
+            if (end - p >= 3 && strncmp(p, "Int", 3) == 0) p += 3;
+            while (p < end && isSpace(*p)) p++;
+        }
+
+        long long value = 0;
+        digits = p;
+        while (p < end && isdigit((unsigned char)*p)) {
+            value = min(value * 10 + (*p++ - '0'), (long long)INT_MAX);
+        }
+        if (p != digits) assign((int)cell, (int)value);
+    }
+    return 1;
+}
+
+bool SolverContext::loadSMTsolvedBoard(const std::string& filename) {
+    const char* problem = loadSMTmodel(filename);
+    if (problem) {
+        std::cout << problem << ": " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//Loads solver output for the board that is loaded now. The board is only replaced if the model solves it:
+//every cell filled, every group exactly its number and all clues kept. Returns what is wrong, or nullptr.
+const char* SolverContext::loadSMTmodel(const std::string& filename) {
+    //one buffer per thread, so loading many files in a row does not allocate
+    static thread_local vector<char> text;
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file) return "cannot open the file";
+    text.clear();
+    char chunk[1 << 14];
+    size_t count;
+    while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        text.insert(text.end(), chunk, chunk + count);
+    }
+    fclose(file);
+    return applySMTmodel(text.data(), text.data() + text.size());
+}
+
+//loadSMTmodel for solver output that is already in memory
+const char* SolverContext::applySMTmodel(const char* begin, const char* end) {
+    modelBackup.assign(board.cells.begin(), board.cells.end());
+    for (int i = 0; i < Height; i++) {
+        for (int j = 0; j < Width; j++) {
+            board[i][j] = 0;
+        }
+    }
+
+    int cells = Height * Width;
+    bool inRange = true;
+    int status = parseSmtModel(begin, end, [&](int cell, int number) {
+        if (cell >= cells || number < 1 || number >= BORDER) {
+            inRange = false;
+            return;
+        }
+        board[cell / Width][cell % Width] = number;
+    });
+
+    const char* problem = nullptr;
+    if (status < 0) problem = "error reading the file";
+    else if (status == 0) problem = "No solution";
+    else if (!inRange) problem = "model does not fit the board";
+    else if (!verifySolution()) problem = "model is not a solution of the board";
+
+    if (problem) {
+        copy(modelBackup.begin(), modelBackup.end(), board.cells.begin());
+        findAndStoreGroups();
+    }
+    return problem;
+}
+
+//linear check of a full board: no empty cells, clues kept and every group exactly its number
+bool SolverContext::verifySolution() {
+    for (int i = 0; i < Height; i++) {
+        for (int j = 0; j < Width; j++) {
+            if (board[i][j] == 0) return false;
+        }
+    }
+    for (auto [i, j, number] : fixedCells) {
+        if (board[i][j] != number) return false;
+    }
+    findAndStoreGroups();
+    return groups.wrongSizeGroups == 0 && groups.overfilledGroups == 0;
+}
+
+bool SolverContext::allGroupsAreExactlyFilled() {
+    return groups.wrongSizeGroups == 0;
+}
+
+// Check if a cell is within the board
+bool SolverContext::isValid(int i, int j) {
+    return (i >= 0 && i < Height && j >= 0 && j < Width);
+}
+
+bool SolverContext::existsOverfilledGroup() {
+    return groups.overfilledGroups > 0;
+}
+
+void SolverContext::displayBoard() {
+    cout << "Board Layout:" << endl;
+    for (int i = 0; i < Height; i++) {
+        for (int j = 0; j < Width; j++) {
+            cout << int(board[i][j]) << " ";
+        }
+        cout << endl;
+    }
+    cout << endl;
+}
+
+// Find the size of the group a filled cell belongs to
+int SolverContext::getGroupSize(int cell) {
+    STAT_ADD(groupSizeCalls, 1);
+    return groups.nodes[groups.find(cell)].size;
+}
+
+//gives the number a bit in NumberMask, false if there are too many different numbers
+bool SolverContext::addNumberSlot(int number) {
+    if (numberSlot[number] >= 0) return true;
+    if (slotNumbers.size() >= MAX_NUMBER_SLOTS) return false;
+
+    numberSlot[number] = slotNumbers.size();
+    slotNumbers.push_back(number);
+
+    //a new number is a new candidate for every empty cell
+    for (size_t cell = 0; cell < domains.size(); cell++) {
+        if (board.cells[cell] == 0) {
+            domains[cell] |= numberBit(number);
+        }
+    }
+    return true;
+}
+
+bool SolverContext::maskHasNumber(NumberMask mask, int number) const {
+    return numberSlot[number] >= 0 && ((mask >> numberSlot[number]) & 1);
+}
+
+NumberMask SolverContext::numberBit(int number) const {
+    return NumberMask(1) << numberSlot[number];
+}
+
+//the number if the mask holds exactly one, 0 if it is empty and -1 if it holds more
+int SolverContext::singleNumber(NumberMask mask) const {
+    if (mask == 0) return 0;
+    if (mask & (mask - 1)) return -1;
+    return slotNumbers[__builtin_ctzll(mask)];
+}
+
+//For every incomplete group one bounded flood from all its cells at once marks the empty cells it can still
+//reach (number - group size moves through empty cells), so reach[] answers for all cells and numbers what
+//used to take a canReach() BFS per (source cell, target cell, number).
+void SolverContext::computeReachability() {
+    STAT_ADD(reachabilityPasses, 1);
+    if (options.floodKernel != FloodKernel::Check) {
+        (this->*kernels->reachPass)(options.floodKernel == FloodKernel::Bitboard);
+        return;
+    }
+    (this->*kernels->reachPass)(false);
+    vector<NumberMask> expected = reach;
+    (this->*kernels->reachPass)(true);
+    if (reach != expected) kernelMismatches++;
+}
+
+template <class Shape>
+void SolverContext::reachPass(bool bitboard) {
+    Shape shape(board);
+    fill(reach.begin(), reach.end(), 0);
+    const BitGrid& emptyGrid = groups.emptyGrid;
+
+    for (int i = 0; i < shape.height; i++) {
+        for (int j = 0; j < shape.width; j++) {
+            int root = shape.index(i, j);
+            if (board.cells[root] == 0 || !groups.isRoot(root)) continue;
+
+            int number = board.cells[root];
+            int allowedMoves = number - getGroupSize(root);
+            if (allowedMoves <= 0 || numberSlot[number] < 0) continue;
+            NumberMask bit = NumberMask(1) << numberSlot[number];
+
+            if (bitboard) {
+                //one flood step per move on the rows it can have got to, then every flooded empty cell is reachable
+                int top, bottom;
+                groupGrid(root, floodGrid, top, bottom);
+                int begin = top, end = bottom + 1;
+                for (int moves = 0; moves < allowedMoves; moves++) {
+                    begin = max(0, begin - 1);
+                    end = min(shape.height, end + 1);
+                    if (!floodStep(floodGrid, emptyGrid, emptyGrid, floodNext, begin, end)) break;
+                    swap(floodGrid, floodNext);
+                }
+                for (int r = begin; r < end; r++) {
+                    const uint64_t* flooded = floodGrid.row(r);
+                    const uint64_t* empty = emptyGrid.row(r);
+                    for (int w = 0; w < floodGrid.rowWords; w++) {
+                        for (uint64_t bits = flooded[w] & empty[w]; bits; bits &= bits - 1) {
+                            reach[shape.index(r, w * 64 + __builtin_ctzll(bits))] |= bit;
+                        }
+                    }
+                }
+                floodGrid.clearRows(begin, end);
+                floodNext.clearRows(begin, end);
+                continue;
+            }
+
+            scratch.start();
+            int cell = root;
+            do {
+                scratch.mark(cell);
+                scratch.push(cell);
+                cell = groups.nodes[cell].next;
+            } while (cell != root);
+
+            //one layer of the BFS per move
+            for (int moves = 0; moves < allowedMoves && !scratch.empty(); moves++) {
+                size_t layerEnd = scratch.tail;
+                while (scratch.head < layerEnd) {
+                    int from = scratch.pop();
+                    for (int offset : shape.offsets) {
+                        int next = from + offset;
+                        if (!scratch.seen(next) && board.cells[next] == 0) {
+                            scratch.mark(next);
+                            reach[next] |= bit;
+                            scratch.push(next);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+//sets the cells of the group in grid, top and bottom are its first and last row
+void SolverContext::groupGrid(int root, BitGrid& grid, int& top, int& bottom) {
+    top = Height;
+    bottom = -1;
+    int cell = root;
+    do {
+        int i = board.row(cell);
+        grid.set(i, board.col(cell));
+        top = min(top, i);
+        bottom = max(bottom, i);
+        cell = groups.nodes[cell].next;
+    } while (cell != root);
+}
+
+//a number that can not reach a cell anymore will never be able to, so it leaves the domain for good
+void SolverContext::narrowDomainsByReach() {
+    computeReachability();
+    for (size_t cell = 0; cell < domains.size(); cell++) {
+        if (board.cells[cell] == 0) {
+            restrictDomain(cell, reach[cell]);
+        }
+    }
+}
+
+void SolverContext::restrictDomain(int cell, NumberMask allowed) {
+    NumberMask narrowed = domains[cell] & allowed;
+    if (narrowed != domains[cell]) {
+        domainTrail.emplace_back(cell, domains[cell]);
+        domains[cell] = narrowed;
+    }
+}
+
+TrailMark SolverContext::trailMark() const {
+    return {groups.fills.size(), domainTrail.size()};
+}
+
+//takes back every fill and domain change made after the mark, newest first
+void SolverContext::undoTo(const TrailMark& mark) {
+    while (groups.fills.size() > mark.fills) {
+        board.cells[groups.undo()] = 0;
+    }
+    while (domainTrail.size() > mark.domainChanges) {
+        domains[domainTrail.back().first] = domainTrail.back().second;
+        domainTrail.pop_back();
+    }
+}
+
+//an empty cell without candidates means the board can not be solved anymore
+bool SolverContext::existsEmptyDomain() {
+    for (size_t cell = 0; cell < domains.size(); cell++) {
+        if (board.cells[cell] == 0 && domains[cell] == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//find groups in the board and store them, only needed when the board changed outside fillCell
+void SolverContext::findAndStoreGroups() {
+    STAT_ADD(groupRebuilds, 1);
+    groups.rebuild(board);
+
+    fill_n(numberSlot, 256, -1);
+    slotNumbers.clear();
+    kernels = &boardKernels(Height, Width, options.specializedKernels);
+    scratch.resize(board.cells.size());
+    floodGrid.resize(Height, Width);
+    floodNext.resize(Height, Width);
+    reach.assign(board.cells.size(), 0);
+    domains.assign(board.cells.size(), 0);
+    domainTrail.clear();
+    for (int i = 0; i < Height; i++) {
+        for (int j = 0; j < Width; j++) {
+            if (board[i][j] >= 2) {
+                addNumberSlot(board[i][j]);
+            }
+        }
+    }
+}
+
+//Checks if exactly 1 number is left for this cell, the domains are narrowed by narrowDomainsByReach()
+//0 means no number can reach the empty cell, -1 that more than 1 number can reach it
+int SolverContext::checkReachability(int targetRow, int targetCol) {
+    return singleNumber(domains[board.index(targetRow, targetCol)]);
+}
+
+int SolverContext::checkIfEmptyCellCanBeReachedByOneNum(pair<int, int> &whichCell){
+    //Checks if there is an empty cell on the board that can be reached by only one number
+    whichCell = {-1, -1};
+    narrowDomainsByReach();
+    for (int i = 0; i < Height; i++){
+        for(int j = 0; j < Width; j++){
+            if (isValid(i, j) && board[i][j] == 0){
+                int ReachableCode = checkReachability(i,j);
+                if(ReachableCode > 0){
+                    //Empty cell as parameter, and which number it only can be reached by, will be returned
+                    whichCell = {i, j};
+                    return ReachableCode;
+                }
+
+            }
+        }
+    }
+
+    //No empty cell on the board can be reached by exactly 1 number.
+    return -1;
+}
+
+//the first empty neighbour of the group, -1 if it has none
+int SolverContext::groupExit(int root) {
+    int cell = root;
+    do {
+        for (int offset : board.offsets) {
+            int next = cell + offset;
+            if (board.cells[next] == 0) return next;
+        }
+        cell = groups.nodes[cell].next;
+    } while (cell != root);
+    return -1;
+}
+
+//If we found a group that isnt full with one exit, we store the exit cell in the parameter and return the number.
+int SolverContext::checkSingleExitGroups(pair<int, int> &exitCell) {
+    for (int i = 0; i < Height; i++) {
+        for (int j = 0; j < Width; j++) {
+            int root = board.index(i, j);
+            if (board.cells[root] == 0 || !groups.isRoot(root)) continue;
+
+            const GroupNode& group = groups.nodes[root];
+            int number = board.cells[root];
+
+            //exactly one exit, find which empty cell it leads to
+            if (group.liberties == 1 && group.size < number) {
+                int exit = groupExit(root);
+                exitCell = {board.row(exit), board.col(exit)};
+                return number;
+            }
+        }
+    }
+
+    //no group found with exactly one exit
+    return -1;
+}
+
+bool SolverContext::fillCell(int i, int j, int num) {
+    if (!isValid(i, j) || board[i][j] != 0 || num < 2 || num > maxNumOnBoard) {
+        return false; 
+    }
+
+    if (!addNumberSlot(num)) {
+        return false;
     }
 
     board[i][j] = num;
+    groups.add(board, board.index(i, j));
+    propagations++;
+    return true;  
+}
+
+bool SolverContext::removeCell(int i, int j) {
+    if (isValid(i, j)) {
+        board[i][j] = 0;
+        findAndStoreGroups();
+        return true; 
+    }
+    
+    return false;  
+}
+
+
+bool SolverContext::readBoardFromFile(const string& filename) {
+    ifstream file(filename);
+    if (!file) {
+        cout << "cant open file" << endl;
+        return false;
+    }
+    int height = 0, width = 0;
+    file >> height >> width;
+    if (!file || height <= 0 || width <= 0) {
+        cout << "bad board size in " << filename << endl;
+        return false;
+    }
+
+    vector<Cell> cells(height * width);
+    for (auto& cell : cells) {
+        int value = 0;
+        file >> value;
+        if (value < 0 || value >= BORDER) {
+            cout << "number out of range: " << value << endl;
+            return false;
+        }
+        cell = value;
+    }
+    return loadBoard(height, width, cells.data());
+}
+
+//sets up the context for a puzzle given row by row, 0 for empty cells
+bool SolverContext::loadBoard(int height, int width, const Cell* cells) {
+    if (height <= 0 || width <= 0) {
+        cerr << "bad board size " << height << "x" << width << endl;
+        return false;
+    }
+    for (int k = 0; k < height * width; k++) {
+        if (cells[k] >= BORDER) {
+            cerr << "number out of range: " << int(cells[k]) << endl;
+            return false;
+        }
+    }
+    Height = height;
+    Width = width;
+    board.resize(Height, Width);
+    maxNumOnBoard = DEFAULT_MAX_NUM;
+
+    fixedCells.clear();
+    for (int i = 0; i < Height; i++) {
+        for (int j = 0; j < Width; j++) {
+            board[i][j] = cells[i * Width + j];
+
+            if (board[i][j] != 0) {
+                fixedCells.emplace_back(i, j, board[i][j]);
+                if (board[i][j] > maxNumOnBoard) {
+                    maxNumOnBoard = board[i][j];
+                }
+            }
+        }
+    }
+
+    findAndStoreGroups();
+    scheduler.newBoard(Height, Width);
+    clueSalt = mixHash((uint64_t)Height << 32 | Width);
+    for (auto [i, j, number] : fixedCells) {
+        clueSalt = mixHash(clueSalt ^ zobristKey(board.index(i, j), number));
+    }
+
+    for (auto [i, j, number] : fixedCells) {
+        if (number >= 2 && numberSlot[number] < 0) {
+            cerr << "more than " << MAX_NUMBER_SLOTS << " different numbers on the board" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+//Strategy: a group that still needs cells and has one empty neighbour left has to grow through it
+bool SolverContext::sweepSingleExits() {
+    STAT_TIMER(singleExitNs);
+    bool changed = false;
+    for (int i = 0; i < Height; i++) {
+        for (int j = 0; j < Width; j++) {
+            int root = board.index(i, j);
+            if (board.cells[root] == 0 || !groups.isRoot(root)) continue;
+
+            const GroupNode& group = groups.nodes[root];
+            int number = board.cells[root];
+            if (group.liberties != 1 || group.size >= number) continue;
+
+            int cell = groupExit(root);
+            restrictDomain(cell, numberBit(number));
+            if (domains[cell] == 0) {
+                //the exit can not take the number, the board is unsolvable and the solver will notice
+                return changed;
+            }
+            if (!fillCell(board.row(cell), board.col(cell), number)) {
+                cout << "error with filling the cell";
+            }
+            STAT_ADD(singleExitFills, 1);
+            changed = true;
+            if (showIntermediateProcess) {
+                cout << "Filled cell: (" << board.row(cell) << "," << board.col(cell) << ") with " << number << endl;
+                displayBoard();
+            }
+        }
+    }
+    return changed;
+}
+
+//Strategy: an empty cell that only one number can still reach gets that number. The domains of one
+//computeReachability serve the whole sweep, later fills can only narrow them further.
+bool SolverContext::sweepSingleReachableNumbers() {
+    STAT_TIMER(reachableNs);
+    narrowDomainsByReach();
+    bool changed = false;
+    for (int i = 0; i < Height; i++) {
+        for (int j = 0; j < Width; j++) {
+            int cell = board.index(i, j);
+            if (board.cells[cell] != 0) continue;
+
+            int number = singleNumber(domains[cell]);
+            if (number <= 0) continue;
+            if (!fillCell(i, j, number)) {
+                cout << "error with filling the cell";
+            }
+            STAT_ADD(reachableFills, 1);
+            changed = true;
+            if (showIntermediateProcess) {
+                cout << "Filled cell: (" << i << "," << j << ") with " << number << endl;
+                displayBoard();
+            }
+        }
+    }
+    return changed;
+}
+
+bool SolverContext::canGroupBeCompleted(int root) {
+    return (this->*kernels->canGroupBeCompleted)(root);
+}
+
+template <class Shape>
+bool SolverContext::canGroupBeCompletedIn(int root) {
+    STAT_ADD(completionChecks, 1);
+    Shape shape(board);
+    int currentGroupSize = groups.nodes[root].size;
+    int targetSize = board.cells[root];
+    int requiredEmptyCells = targetSize - currentGroupSize;
+
+    if (requiredEmptyCells <= 0) {
+        return false;  // Group is already complete
+    }
+
+    // BFS over the empty cells around the group, the group's own cells count as visited
+    scratch.start();
+    int cell = root;
+    do {
+        scratch.mark(cell);
+        cell = groups.nodes[cell].next;
+    } while (cell != root);
+
+    // Enqueue all the boundary cells of the group to start BFS from
+    do {
+        for (int offset : shape.offsets) {
+            int next = cell + offset;
+
+            if (!scratch.seen(next) && board.cells[next] == 0) {
+                scratch.mark(next);
+                scratch.push(next);
+            }
+        }
+        cell = groups.nodes[cell].next;
+    } while (cell != root);
+
+    int emptyCellsFound = 0;
+
+    while (!scratch.empty()) {
+        int cell = scratch.pop();
+
+        // If we've found enough empty cells, return true
+        if (++emptyCellsFound >= requiredEmptyCells) {
+            return true;
+        }
+
+        for (int offset : shape.offsets) {
+            int next = cell + offset;
+
+            //Instead of just checking empty cells, also check if we come across a same number, we could potentially merge with
+            //making it so we do have enough cells to complete to group
+            if (!scratch.seen(next) && (board.cells[next] == 0 || board.cells[next] == targetSize)) {
+                scratch.mark(next);
+                scratch.push(next);
+            }
+        }
+    }
+
+    // Not enough adjacent empty cells to complete the group
+    return false;
+}
+
+//canGroupBeCompleted with bitboards: the fillable region is everything the group floods through empty cells
+//and cells of its own number. Only the rows around the flood take part, one more on each side per step.
+bool SolverContext::canGroupBeCompletedByFlood(int root) {
+    STAT_ADD(completionChecks, 1);
+    int number = board.cells[root];
+    if (groups.nodes[root].size >= number) return false;
+
+    int top, bottom;
+    groupGrid(root, floodGrid, top, bottom);
+    int begin = top, end = bottom + 1;
+    const BitGrid& same = groups.numberGrids[number];
+    bool completable = false;
+    while (true) {
+        begin = max(0, begin - 1);
+        end = min(Height, end + 1);
+        if (!floodStep(floodGrid, groups.emptyGrid, same, floodGrid, begin, end)) break;
+        //the group counts too, so the region is big enough at number cells
+        if (floodGrid.count(begin, end) >= number) {
+            completable = true;
+            break;
+        }
+    }
+    floodGrid.clearRows(begin, end);
+    return completable;
+}
+
+void SolverContext::checkIncompleteGroups() {
+    for (int i = 0; i < Height; i++) {
+        for (int j = 0; j < Width; j++) {
+            int root = board.index(i, j);
+            if (board.cells[root] == 0 || !groups.isRoot(root)) continue;
+
+            int number = board.cells[root];
+            if (groups.nodes[root].size < number) {
+                // The group is incomplete, check if it can be completed
+                bool canBeCompleted = canGroupBeCompleted(root);
+
+                cout << "Checking Group " << number << " with cells: ";
+                int cell = root;
+                do {
+                    cout << "(" << board.row(cell) << "," << board.col(cell) << ") ";
+                    cell = groups.nodes[cell].next;
+                } while (cell != root);
+                cout << endl;
+
+                if (canBeCompleted) {
+                    cout << "Group " << number << " can be completed." << endl;
+                } else {
+                    cout << "Group " << number << " cannot be completed." << endl;
+                }
+            }
+        }
+    }
+}
+
+bool SolverContext::canAllGroupsBeCompleted() {
+    return (this->*kernels->canAllGroupsBeCompleted)();
+}
+
+template <class Shape>
+bool SolverContext::canAllGroupsBeCompletedIn(){
+    Shape shape(board);
+    bool bitboard = options.floodKernel != FloodKernel::Bfs;
+    for (int i = 0; i < shape.height; i++) {
+        for (int j = 0; j < shape.width; j++) {
+            int root = shape.index(i, j);
+            if (board.cells[root] == 0 || !groups.isRoot(root)) continue;
+
+            if (groups.nodes[root].size < board.cells[root]){
+                bool completable = bitboard ? canGroupBeCompletedByFlood(root) : canGroupBeCompletedIn<Shape>(root);
+                if (options.floodKernel == FloodKernel::Check && completable != canGroupBeCompletedIn<Shape>(root)) {
+                    kernelMismatches++;
+                }
+                //there is at least one group that cannot be completed
+                if(!completable){
+                    return false;
+                }
+            }
+        }
+    }
+
+    //all groups can be completed
+    return true;
+}
+
+template <class Shape>
+constexpr BoardKernels kernelsFor(int height, int width) {
+    return {height, width, &SolverContext::reachPass<Shape>, &SolverContext::canGroupBeCompletedIn<Shape>,
+            &SolverContext::canAllGroupsBeCompletedIn<Shape>};
+}
+
+//the sizes most puzzles come in: the usual square boards and the common Janko sizes
+const BoardKernels SPECIALIZED_KERNELS[] = {
+    kernelsFor<FixedShape<10, 10>>(10, 10),
+    kernelsFor<FixedShape<15, 15>>(15, 15),
+    kernelsFor<FixedShape<17, 17>>(17, 17),
+    kernelsFor<FixedShape<20, 20>>(20, 20),
+    kernelsFor<FixedShape<20, 28>>(20, 28),
+    kernelsFor<FixedShape<20, 36>>(20, 36),
+};
+const BoardKernels GENERIC_KERNELS = kernelsFor<RuntimeShape>(0, 0);
+
+//the instances for a board size, the generic ones when there is no specialized instance or it is not wanted
+const BoardKernels& boardKernels(int height, int width, bool specialized) {
+    if (specialized) {
+        for (const BoardKernels& kernels : SPECIALIZED_KERNELS) {
+            if (kernels.height == height && kernels.width == width) return kernels;
+        }
+    }
+    return GENERIC_KERNELS;
+}
+
+int SolverContext::findDefinitiveNumber(pair<int, int> &defCell) {
+    narrowDomainsByReach();
+    for (int i = 0; i < Height; i++) {
+        for (int j = 0; j < Width; j++) {
+            if (board[i][j] == 0) {
+                int number = definitiveNumber(board.index(i, j));
+                if (number > 0) {
+                    defCell = {i, j};
+                    return number;
+                }
+            }
+        }
+    }
+
+    //No cell found where we can figure out a possible definitive number.
+    return -1;
+}
+
+//The only number of the empty cell's domain that leaves every group completable and none overfilled, -1 if
+//there is none or more than one. Numbers that fail leave the domain for good.
+int SolverContext::definitiveNumber(int cell) {
+    int validCount = 0;
+    int lastValidNumber = -1;
+    // Test filling the cell with each possible number
+    for (int num = 2; num <= maxNumOnBoard; num++) {
+        if (!maskHasNumber(domains[cell], num)) continue;
+
+        board.cells[cell] = num; // Temporarily place the number
+        groups.add(board, cell);
+        if (canAllGroupsBeCompleted() && !existsOverfilledGroup()) {
+            validCount++;
+            lastValidNumber = num;
+        } else {
+            // This number breaks the board now and on every fuller board, so drop it for good
+            restrictDomain(cell, ~numberBit(num));
+        }
+        groups.undo();
+        board.cells[cell] = 0; // Revert change
+
+        if (validCount > 1) {
+            return -1;
+        }
+    }
+    return validCount == 1 ? lastValidNumber : -1;
+}
+
+//Strategy: an empty cell with exactly one number that does not break the board gets it. The sweep goes
+//on after a fill instead of starting over, a fill only takes numbers away from the cells after it.
+bool SolverContext::sweepDefinitiveNumbers() {
+    STAT_TIMER(definitiveNs);
+    narrowDomainsByReach();
+    bool changed = false;
+    for (int i = 0; i < Height && !shouldStop(); i++) {
+        for (int j = 0; j < Width; j++) {
+            if (board[i][j] != 0) continue;
+
+            int number = definitiveNumber(board.index(i, j));
+            if (number < 0) continue;
+            if (!fillCell(i, j, number)) {
+                cout << "Error filling cell (" << i << ", " << j << ") with " << number << endl;
+            }
+            STAT_ADD(definitiveFills, 1);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+//The deduction strategies of applyAllDeterministicFilling, from cheap to expensive. A strategy sweeps the
+//board once, fills what it can prove and tells whether it changed anything; a new rule only needs an entry.
+const DeductionStrategy DEDUCTION_STRATEGIES[] = {
+    {"single exits", &SolverContext::sweepSingleExits},
+    {"single reachable number", &SolverContext::sweepSingleReachableNumbers},
+    {"definitive numbers", &SolverContext::sweepDefinitiveNumbers},
+};
+const int STRATEGY_COUNT = size(DEDUCTION_STRATEGIES);
+
+//Runs the strategies until none of them changes the board. Every change starts over at the first strategy,
+//so the cheap rules reach their fixpoint before an expensive one runs again. The adaptive schedule takes
+//the strategies in the order of their measured time per filled cell on the recent boards of this size, and
+//skips the ones that have been idle for a while (see StrategyRecord::skip).
+void SolverContext::applyAllDeterministicFilling() {
+    bool adaptive = options.strategySchedule == StrategySchedule::Adaptive;
+    if (scheduler.records.size() != STRATEGY_COUNT) {
+        scheduler.reset(Height, Width, STRATEGY_COUNT);
+    }
+
+    for (int k = 0; k < STRATEGY_COUNT;) {
+        if (shouldStop()) return;
+        int strategy = adaptive ? scheduler.order[k] : k;
+        StrategyRecord& record = scheduler.records[strategy];
+        if (adaptive && record.skip()) {
+            k++;
+            continue;
+        }
+
+        long long filledBefore = propagations;
+        auto start = chrono::steady_clock::now();
+        bool changed = (this->*DEDUCTION_STRATEGIES[strategy].sweep)();
+        record.ran(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count(),
+                   propagations - filledBefore);
+        k = changed ? 0 : k + 1;
+    }
+    if (adaptive) scheduler.reorder();
+}
+
+//cells the group next to this cell still needs, the smallest one over the neighbouring groups with this number
+int SolverContext::neighbourSlack(int cell, int number) {
+    int slack = INT_MAX;
+    for (int offset : board.offsets) {
+        int next = cell + offset;
+        if (board.cells[next] == number) {
+            slack = min(slack, number - getGroupSize(next));
+        }
+    }
+    return slack;
+}
+
+//the empty cell to branch on according to options.cellHeuristic, -1 if the board is full
+int SolverContext::chooseBranchCell() {
+    int best = -1;
+    int bestSlack = INT_MAX;
+    int bestCandidates = INT_MAX;
+
+    for (int i = 0; i < Height; i++) {
+        for (int j = 0; j < Width; j++) {
+            int cell = board.index(i, j);
+            if (board.cells[cell] != 0) continue;
+            if (options.cellHeuristic == CellHeuristic::FirstEmpty) return cell;
+
+            int candidates = __builtin_popcountll(domains[cell]);
+            int slack = INT_MAX;
+            if (options.cellHeuristic == CellHeuristic::NearlyCompleteGroup) {
+                for (int number = 2; number <= maxNumOnBoard; number++) {
+                    if (maskHasNumber(domains[cell], number)) {
+                        slack = min(slack, neighbourSlack(cell, number));
+                    }
+                }
+            }
+
+            if (slack < bestSlack || (slack == bestSlack && candidates < bestCandidates)) {
+                best = cell;
+                bestSlack = slack;
+                bestCandidates = candidates;
+            }
+        }
+    }
+    return best;
+}
+
+//the numbers left for the cell in the order options.valueOrder wants them tried
+void SolverContext::branchNumbers(int cell, vector<int>& numbers) {
+    numbers.clear();
+    for (int num = 2; num <= maxNumOnBoard; num++) {
+        if (maskHasNumber(domains[cell], num)) {
+            numbers.push_back(num);
+        }
+    }
+
+    if (options.valueOrder == ValueOrder::GroupSlack) {
+        int slack[256];
+        for (int num : numbers) {
+            slack[num] = neighbourSlack(cell, num);
+        }
+        //ties stay ascending, sort() does not need the buffer of stable_sort
+        sort(numbers.begin(), numbers.end(), [&](int a, int b) { return slack[a] != slack[b] ? slack[a] < slack[b] : a < b; });
+    }
+}
+
+RefutationTable* SolverContext::refutationTable() {
+    if (!refuted && options.refutationTableMB > 0) {
+        refuted = make_shared<RefutationTable>(options.refutationTableMB);
+    }
+    return refuted.get();
+}
+
+bool SolverContext::solveWithBacktracking(int currentDepth) {
+    if (search && search->stop.load(memory_order_relaxed)) {
+        return false;
+    }
+    //the clock is only read every 64 nodes
+    if (shouldStop((nodes & 63) == 0)) {
+        return false;
+    }
+
+    //a board that failed before fails again, whichever order of branches led to it
+    RefutationTable* table = refutationTable();
+    uint64_t entryHash = groups.hash ^ clueSalt;
+    if (table) {
+        if (table->contains(entryHash)) {
+            refutedHits++;
+            return false;
+        }
+        refutedMisses++;
+    }
+
+    long long givenAway = tasksGivenAway;
+    long long found = solutionsFound;
+    if (searchNode(currentDepth)) {
+        return true;
+    }
+
+    //only a fully explored subtree without solutions proves that the board has no solution
+    if (table && givenAway == tasksGivenAway && found == solutionsFound && stopReason == StopReason::None &&
+        !(search && search->stop)) {
+        table->insert(entryHash);
+    }
+    return false;
+}
+
+bool SolverContext::searchNode(int currentDepth) {
+    nodes++;
+    STAT_ADD(searchNodes, 1);
+    if ((showDepth || depthExperiment) && currentDepth > maxDepth) {
+        maxDepth = currentDepth;
+    }
+
+    applyAllDeterministicFilling();
+
+    if (stopReason != StopReason::None) {
+        return false;
+    }
+    if (existsOverfilledGroup() || !canAllGroupsBeCompleted()) {
+        STAT_ADD(failures, 1);
+        return false;
+    }
+
+    if (allGroupsAreExactlyFilled()) {
+        if (solutionLimit == 0) {
+            return true;
+        }
+        //when counting only full boards are solutions, under the standard rules empty cells are a dead end
+        for (int cell = 0; cell < (int)board.cells.size(); cell++) {
+            if (board.cells[cell] == 0) return false;
+        }
+        solutionsFound++;
+        long long total = solutionsFound;
+        if (search) {
+            total = ++search->solutionsFound;
+        }
+        return total >= solutionLimit;
+    }
+
+    narrowDomainsByReach();
+    if (existsEmptyDomain()) {
+        STAT_ADD(failures, 1);
+        return false;
+    }
+
+    int cell = chooseBranchCell();
+    if (cell < 0) {
+        return false;
+    }
+
+    //everything filled or narrowed below this node is undone through the trail
+    TrailMark mark = trailMark();
+    //one buffer per depth, kept from node to node
+    while ((int)branchBuffers.size() <= currentDepth) {
+        branchBuffers.emplace_back();
+    }
+    vector<int>& numbers = branchBuffers[currentDepth];
+    branchNumbers(cell, numbers);
+
+    for (int num : numbers) {
+        decisions.emplace_back(cell, num);
+
+        //in a parallel search, later branches go to idle workers instead
+        if (search && num != numbers.front() && currentDepth < search->maxSplitDepth && search->hungry()) {
+            search->push(workerId, decisions);
+            tasksGivenAway++;
+            decisions.pop_back();
+            continue;
+        }
+
+        board.cells[cell] = num;
+        groups.add(board, cell);
+
+        if (solveWithBacktracking(currentDepth + 1)) {
+            return true;
+        }
+
+        // Backtrack
+        undoTo(mark);
+        decisions.pop_back();
+        STAT_ADD(backtracks, 1);
+    }
+
+    if (showDepth && !numbers.empty()) {
+        int depthGap = maxDepth - currentDepth;
+        depthGapHistogram[depthGap]++;
+    }
+
+    return false;
+}
+
+//Solves the board with one worker per thread. Every worker has its own copy of the context and
+//explores subtrees from its own deque, stealing from the others when it runs dry. Workers split off
+//branches only while another worker is idle, and all of them stop once one finds a solution.
+bool SolverContext::solveInParallel(int threads) {
+    //the propagation at the root is shared by all subtrees, do it once before copying
+    applyAllDeterministicFilling();
+    refutationTable();
+
+    ParallelSearch shared(threads);
+    shared.push(0, {});
+
+    vector<SolverContext> workers(threads, *this);
+    auto work = [&](int id) {
+        SolverContext& ctx = workers[id];
+        ctx.search = &shared;
+        ctx.workerId = id;
+        ctx.resetStats();
+        long long allocationsBefore = threadAllocations;
+        TrailMark root = ctx.trailMark();
+
+        bool idle = false;
+        DecisionPath path;
+        while (!shared.stop) {
+            if (!shared.pop(id, path) && !shared.steal(id, path)) {
+                if (!idle) {
+                    idle = true;
+                    shared.idleWorkers++;
+                }
+                if (shared.pendingTasks == 0) break;
+                this_thread::yield();
+                continue;
+            }
+            if (idle) {
+                idle = false;
+                shared.idleWorkers--;
+            }
+
+            //replay the branches of the subtree on top of the root
+            ctx.undoTo(root);
+            for (auto [cell, num] : path) {
+                ctx.board.cells[cell] = num;
+                ctx.groups.add(ctx.board, cell);
+            }
+            ctx.decisions = path;
+
+            if (ctx.solveWithBacktracking(path.size())) {
+                lock_guard<mutex> guard(shared.resultLock);
+                if (!shared.solved) {
+                    shared.solved = true;
+                    shared.solution = ctx.board;
+                }
+                shared.stop = true;
+            }
+            shared.pendingTasks--;
+        }
+        if (idle) {
+            shared.idleWorkers--;
+        }
+        ctx.stats.heapAllocations += threadAllocations - allocationsBefore;
+    };
+
+    vector<thread> pool;
+    for (int id = 0; id < threads; id++) {
+        pool.emplace_back(work, id);
+    }
+    for (auto& t : pool) {
+        t.join();
+    }
+
+    for (const auto& worker : workers) {
+        nodes += worker.nodes;
+        refutedHits += worker.refutedHits;
+        refutedMisses += worker.refutedMisses;
+        kernelMismatches += worker.kernelMismatches;
+        maxDepth = max(maxDepth, worker.maxDepth);
+        stats.add(worker.stats);
+        if (stopReason == StopReason::None && !shared.solved) stopReason = worker.stopReason;
+    }
+    if (solutionLimit > 0) {
+        solutionsFound = min(shared.solutionsFound.load(), solutionLimit);
+    }
+    if (shared.solved) {
+        board = shared.solution;
+        findAndStoreGroups();
+    }
+    return shared.solved;
+}
+
+//solves the board as given with FillominoSatSolver. Regions without a clue can get numbers up to
+//maxNumOnBoard, the same bound the SMT export uses. Only counting uses more than one thread.
+bool SolverContext::solveWithSat(int threads) {
+    vector<tuple<int, int, int>> clues;
+    for (int i = 0; i < Height; i++) {
+        for (int j = 0; j < Width; j++) {
+            if (board[i][j] != 0) clues.emplace_back(i, j, board[i][j]);
+        }
+    }
+    if (solutionLimit > 0 && threads > 1 && (int)clues.size() < Height * Width) {
+        return countWithSatInParallel(threads, clues);
+    }
+
+    FillominoSatSolver solver;
+    solver.sat.deadline = deadline;
+    solver.sat.cancel = cancel;
+    solver.sat.decisionBudget = options.nodeBudget;
+    solver.sat.propagationBudget = options.propagationBudget;
+    vector<int> solution;
+    int status = solver.solve(Height, Width, maxNumOnBoard, clues, solution);
+    //when counting every solution is blocked in turn, the budgets cover all of the calls
+    vector<int> last;
+    while (solutionLimit > 0 && status == 1) {
+        last = solution;
+        if (++solutionsFound >= solutionLimit) break;
+        solver.block(solution);
+        status = solver.next(solution);
+    }
+    if (!last.empty()) {
+        solution = last;
+        status = status == -1 ? -1 : 1;
+    }
+    nodes = solver.sat.decisions;
+    if (status == -1) stopReason = solver.sat.stopReason;
+    if (status != 1 && last.empty()) return false;
+
+    for (int i = 0; i < Height; i++) {
+        for (int j = 0; j < Width; j++) {
+            board[i][j] = solution[i * Width + j];
+        }
+    }
+    findAndStoreGroups();
+    return allGroupsAreExactlyFilled();
+}
+
+//Counting on several threads. The numbers of up to two empty cells split the solutions into disjoint cubes,
+//the threads take whole cubes and count them with their own FillominoSatSolver until the limit is reached
+//together. Every thread gets the full budgets, nodes are the decisions of all of them.
+bool SolverContext::countWithSatInParallel(int threads, const vector<tuple<int, int, int>>& clues) {
+    //cells next to clues are often forced, the ones with the most empty neighbours give cubes of similar size
+    auto emptyNeighbours = [&](int cell) {
+        int count = 0;
+        for (int offset : board.offsets) count += board.cells[cell + offset] == 0;
+        return count;
+    };
+    vector<int> splitCells;
+    for (int round = 0; round < 2; round++) {
+        int best = -1;
+        for (int i = 0; i < Height; i++) {
+            for (int j = 0; j < Width; j++) {
+                int cell = board.index(i, j);
+                if (board.cells[cell] != 0 || count(splitCells.begin(), splitCells.end(), cell)) continue;
+                if (best < 0 || emptyNeighbours(cell) > emptyNeighbours(best)) best = cell;
+            }
+        }
+        if (best >= 0) splitCells.push_back(best);
+    }
+    int cubes = 1;
+    for (size_t k = 0; k < splitCells.size(); k++) cubes *= maxNumOnBoard;
+
+    atomic<int> nextCube{0};
+    atomic<long long> found{0};
+    atomic<bool> stop{false}; //the limit is reached, a cube was stopped or the caller cancelled
+    mutex lock;
+    condition_variable finished;
+    int running = threads;
+    long long decisions = 0;
+    StopReason stoppedBy = StopReason::None;
+    vector<int> anySolution;
+
+    auto worker = [&]() {
+        //one solver per thread, the cubes go in as assumptions so what it learnt carries over to the next cube
+        FillominoSatSolver solver;
+        solver.sat.deadline = deadline;
+        solver.sat.cancel = &stop;
+        solver.sat.decisionBudget = options.nodeBudget;
+        solver.sat.propagationBudget = options.propagationBudget;
+        solver.encode(Height, Width, maxNumOnBoard);
+        for (auto [i, j, number] : clues) {
+            solver.sat.addClause({solver.cellLit(i * Width + j, number)});
+        }
+
+        vector<int> solution, last;
+        int status = 0;
+        for (int index = nextCube++; index < cubes && !stop; index = nextCube++) {
+            solver.sat.assumptions.clear();
+            int rest = index;
+            for (int cell : splitCells) {
+                solver.sat.assumptions.push_back(
+                    solver.cellLit(board.row(cell) * Width + board.col(cell), rest % maxNumOnBoard + 1));
+                rest /= maxNumOnBoard;
+            }
+            status = solver.next(solution);
+            while (status == 1) {
+                last = solution;
+                if (++found >= solutionLimit) {
+                    stop = true;
+                    break;
+                }
+                solver.block(solution);
+                status = solver.next(solution);
+            }
+            if (status == -1) break;
+        }
+
+        lock_guard<mutex> guard(lock);
+        decisions += solver.sat.decisions;
+        if (!last.empty()) anySolution = last;
+        //a thread that was only stopped because another one reached the limit leaves the count complete
+        if (status == -1 && found < solutionLimit && stoppedBy == StopReason::None) {
+            stoppedBy = solver.sat.stopReason;
+            stop = true;
+        }
+        running--;
+        finished.notify_all();
+    };
+
+    vector<thread> pool;
+    for (int t = 0; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    {
+        //the cubes only see stop, so the caller's cancel token is passed on from here
+        unique_lock<mutex> guard(lock);
+        while (running > 0) {
+            finished.wait_for(guard, chrono::milliseconds(10));
+            if (cancel && cancel->load(memory_order_relaxed)) stop = true;
+        }
+    }
+    for (auto& t : pool) {
+        t.join();
+    }
+
+    nodes = decisions;
+    solutionsFound = found;
+    if (stoppedBy != StopReason::None) stopReason = stoppedBy;
+    if (anySolution.empty()) return false;
+    for (int i = 0; i < Height; i++) {
+        for (int j = 0; j < Width; j++) {
+            board[i][j] = anySolution[i * Width + j];
+        }
+    }
+    findAndStoreGroups();
+    return allGroupsAreExactlyFilled();
+}
+
+//Races solveWithBacktracking against options.smtCommand, which gets the FillominoSMTSolver formula of the
+//board through a pipe. The first solution that passes verifySolution wins, the backtracker is then
+//cancelled or the solver process killed. Without a solution both sides run to the end: the strategies
+//assume that every region has a clue, so the backtracker giving up is no proof on variant boards. Only
+//an unsat from the solver proves there is no solution; a solver that fails, answers unknown or gives a
+//model that does not check leaves the board Undecided.
+bool SolverContext::solvePortfolio() {
+#ifdef _WIN32
+    cerr << "the portfolio needs fork/exec, solving with backtracking only" << endl;
+    return solveWithBacktracking();
+#else
+    signal(SIGPIPE, SIG_IGN); //a solver that dies early must not take us with it
+
+    vector<tuple<int, int, int>> filled;
+    for (int i = 0; i < Height; i++) {
+        for (int j = 0; j < Width; j++) {
+            if (board[i][j] != 0) filled.emplace_back(i, j, board[i][j]);
+        }
+    }
+
+    atomic<bool> nativeCancel{false};
+    SolverContext native = *this;
+    native.cancel = &nativeCancel;
+    SolverContext checker = *this;
+
+    mutex lock;
+    condition_variable changed;
+    bool nativeDone = false, smtDone = false;
+    bool smtUnsat = false;  //the solver answered unsat and exited normally
+    string smtFailure;      //why the solver gave no usable answer
+    const char* winner = nullptr;
+    pid_t child = -1; //guarded by lock, -1 once reaped
+
+    int toChild[2], fromChild[2];
+    if (pipe(toChild) < 0) return solveWithBacktracking();
+    if (pipe(fromChild) < 0) {
+        ::close(toChild[0]);
+        ::close(toChild[1]);
+        return solveWithBacktracking();
+    }
+    for (int fd : {toChild[0], toChild[1], fromChild[0], fromChild[1]}) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    child = fork();
+    if (child == 0) {
+        //only async-signal-safe calls between fork and exec
+        setpgid(0, 0);
+        dup2(toChild[0], 0);
+        dup2(fromChild[1], 1);
+        execl("/bin/sh", "sh", "-c", options.smtCommand.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    ::close(toChild[0]);
+    ::close(fromChild[1]);
+    if (child < 0) {
+        ::close(toChild[1]);
+        ::close(fromChild[0]);
+        return solveWithBacktracking();
+    }
+    setpgid(child, child);
+    pid_t processId = child; //for the smt side, which reaps it
+
+    thread nativeSide([&]() {
+        //the backtracker's answers are checked too, it stops at boards that still have empty cells
+        bool finished = native.solveWithBacktracking();
+        bool solved = finished && native.verifySolution();
+        lock_guard<mutex> guard(lock);
+        nativeDone = true;
+        if (solved && !winner) winner = "backtracking";
+        changed.notify_all();
+    });
+
+    thread smtSide([&]() {
+        FILE* formula = fdopen(toChild[1], "w");
+        if (formula) {
+            {
+                SmtWriter out(formula);
+                FillominoSMTSolver().write(out, Height, Width, filled);
+            }
+            fclose(formula);
+        } else {
+            ::close(toChild[1]);
+        }
+
+        string answer;
+        char chunk[1 << 14];
+        ssize_t count;
+        while ((count = read(fromChild[0], chunk, sizeof(chunk))) > 0) {
+            answer.append(chunk, count);
+        }
+        ::close(fromChild[0]);
+        //Wait for the exit without reaping and without the lock: the main thread must still be able to kill a
+        //solver that closed its output but keeps running. Only the zombie keeps the pid from being reused, so
+        //it is reaped under the lock, after which killpg can no longer reach it.
+        int exitStatus = 0;
+        siginfo_t exited;
+        while (waitid(P_PID, processId, &exited, WEXITED | WNOWAIT) < 0 && errno == EINTR) {}
+        {
+            lock_guard<mutex> guard(lock);
+            waitpid(processId, &exitStatus, 0);
+            child = -1;
+        }
+        bool exitedNormally = WIFEXITED(exitStatus) && WEXITSTATUS(exitStatus) == 0;
+
+        const char* problem = checker.applySMTmodel(answer.data(), answer.data() + answer.size());
+        size_t start = answer.find_first_not_of(" \t\r\n");
+        bool unsat = start != string::npos && answer.compare(start, 5, "unsat") == 0;
+        lock_guard<mutex> guard(lock);
+        smtDone = true;
+        if (!problem && !winner) winner = "smt";
+        smtUnsat = unsat && exitedNormally;
+        if (problem && !smtUnsat) {
+            smtFailure = WIFEXITED(exitStatus) ? "exit status " + to_string(WEXITSTATUS(exitStatus))
+                                               : "killed by signal " + to_string(WTERMSIG(exitStatus));
+            if (start == string::npos) smtFailure += ", no output";
+            else if (unsat) smtFailure += ", answered unsat";
+            else if (answer.compare(start, 7, "unknown") == 0) smtFailure += ", answered unknown";
+            else smtFailure += string(", ") + problem;
+        }
+        changed.notify_all();
+    });
+
+    //wait for a winner, a proof that there is none, or our own limits
+    {
+        unique_lock<mutex> guard(lock);
+        while (!winner && !(nativeDone && smtDone)) {
+            changed.wait_for(guard, chrono::milliseconds(10));
+            if (shouldStop()) break;
+        }
+        nativeCancel = true;
+        if (child > 0) killpg(child, SIGKILL);
+    }
+    nativeSide.join();
+    smtSide.join();
+
+    nodes += native.nodes;
+    maxDepth = max(maxDepth, native.maxDepth);
+    stats.add(native.stats);
+    propagations += native.propagations;
+    answeredBy = winner ? winner : "";
+
+    if (winner && string(winner) == "smt") {
+        board = checker.board;
+        findAndStoreGroups();
+        return true;
+    }
+    if (winner) {
+        board = native.board;
+        findAndStoreGroups();
+        return true;
+    }
+    //nobody found a solution: the solver's proof that there is none, or why the question stays open. The board
+    //is what the backtracker filled before it stopped, so a timeout still hands back the partial board.
+    board = native.board;
     findAndStoreGroups();
-    return true;  
+    if (stopReason == StopReason::None && native.stopReason != StopReason::None) {
+        stopReason = native.stopReason;
+    }
+    if (stopReason == StopReason::None && !smtUnsat) {
+        stopReason = StopReason::Undecided;
+        cerr << "SMT solver \"" << options.smtCommand << "\" gave no answer: " << smtFailure << endl;
+    }
+    return false;
+#endif
 }
 
-bool removeCell(int i, int j) {
-    if (isValid(i, j)) {
-        board[i][j] = 0;
-        findAndStoreGroups();
-        return true; 
+//runs the engine picked in options, within the limits of the options
+//Counts the solutions of the board, stopping at limit, so a limit of 2 proves uniqueness. The count is
+//exact when it is below the limit and stopReason is None, otherwise it is a lower bound. The native
+//search assumes the standard rules (every region has a clue), the SAT engine also handles variants;
+//the portfolio counts with the native search.
+long long SolverContext::countSolutions(long long limit, int threads) {
+    Engine engine = options.engine;
+    if (engine == Engine::Portfolio) options.engine = Engine::Backtracking;
+    solutionLimit = max(1LL, limit);
+    solutionsFound = 0;
+    solve(threads);
+    solutionLimit = 0;
+    options.engine = engine;
+    return min(solutionsFound, limit);
+}
+
+bool SolverContext::solve(int threads) {
+    if (options.timeLimitSeconds > 0) {
+        deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(
+                                                     chrono::duration<double>(options.timeLimitSeconds));
     }
-    
-    return false;  
+
+    [[maybe_unused]] long long allocationsBefore = threadAllocations;
+    kernels = &boardKernels(Height, Width, options.specializedKernels); //the options may have changed since loading
+    bool solved;
+    if (options.engine == Engine::Sat) solved = solveWithSat(threads);
+    else if (options.engine == Engine::Portfolio) solved = solvePortfolio();
+    else solved = threads > 1 ? solveInParallel(threads) : solveWithBacktracking();
+
+    deadline = chrono::steady_clock::time_point::max();
+    STAT_ADD(heapAllocations, threadAllocations - allocationsBefore);
+    return solved;
+}
+
+//Sets stopReason once a limit is reached. The budgets and the cancel token are cheap to check, the clock
+//is only read when readClock is set.
+bool SolverContext::shouldStop(bool readClock) {
+    if (stopReason != StopReason::None) return true;
+    if (cancel && cancel->load(memory_order_relaxed)) {
+        stopReason = StopReason::Cancelled;
+    } else if (options.nodeBudget > 0 && nodes >= options.nodeBudget) {
+        stopReason = StopReason::NodeBudget;
+    } else if (options.propagationBudget > 0 && propagations >= options.propagationBudget) {
+        stopReason = StopReason::PropagationBudget;
+    } else if (readClock && deadline != chrono::steady_clock::time_point::max() &&
+               chrono::steady_clock::now() > deadline) {
+        stopReason = StopReason::Deadline;
+    }
+    return stopReason != StopReason::None;
 }
 
+//status of the last solve for reports: solved, unsolved (proven) or why it stopped without an answer
+const char* SolverContext::statusName(bool solved) const {
+    if (solved) return "solved";
+    switch (stopReason) {
+        case StopReason::Deadline: return "timeout";
+        case StopReason::NodeBudget: return "node-budget";
+        case StopReason::PropagationBudget: return "propagation-budget";
+        case StopReason::Cancelled: return "cancelled";
+        case StopReason::Undecided: return "unknown";
+        default: return "unsolved";
+    }
+}
 
-//fill board with nums 2-maxNumOnBoard
-void fillBoardRandom() {
-    srand(time(0));
-    const int chanceToFill = 60;
+void SolverContext::resetStats() {
+    stopReason = StopReason::None;
+    propagations = 0;
+    stats = SolveStats();
+    maxDepth = 0;
+    nodes = 0;
+    refutedHits = 0;
+    refutedMisses = 0;
+    kernelMismatches = 0;
+}
 
+//per cell (row by row), the number of its group if the group is complete, otherwise 0
+vector<int> SolverContext::completedGroupCells() {
+    vector<int> closed(Height * Width, 0);
     for (int i = 0; i < Height; i++) {
         for (int j = 0; j < Width; j++) {
-            if (rand() % 100 < chanceToFill) { 
-                board[i][j] = rand() % 8 + 2;  //random num
+            int cell = board.index(i, j);
+            if (board.cells[cell] != 0 && getGroupSize(cell) == board.cells[cell]) closed[i * Width + j] = board.cells[cell];
+        }
+    }
+    return closed;
+}
+
+//finds moves for the challenging version of the game, where you can create new groups
+void SolverContext::fillSingleExitCellsAndSafeMoves() {
+    bool somethingFilled = true; //track if any cell is filled
+    pair<int, int> exitcell = {-1, -1};
+    while (somethingFilled && !shouldStop()) {
+        somethingFilled = false;
+        int groupNumber = checkSingleExitGroups(exitcell);  //check if there exists a group with a single exit
+        if (groupNumber != -1) {  //check if such group was found
+            int row = exitcell.first;
+            int col = exitcell.second;
+
+            //fill the group
+            if (fillCell(row, col, groupNumber)) {
+                if (showIntermediateProcess) {
+                    cout << "Filled single exit cell (" << row << "," << col << ") with " << groupNumber << endl;
+                    displayBoard();
+                }
+                somethingFilled = true;
+            }
+        }
+        if (!somethingFilled) {
+            for (int i = 0; i < Height && !shouldStop(); i++) {
+                for (int j = 0; j < Width; j++) {
+                    if (board[i][j] != 0){
+                        continue;
+                    }
+
+                    int validCount = 0;
+                    int lastValidNumber = -1;
+                    for (int num = 1; num <= maxNumOnBoard; num++) {
+                        board[i][j] = num;
+                        groups.add(board, board.index(i, j));
+                        if (canAllGroupsBeCompleted() && !existsOverfilledGroup()) {
+                            validCount++;
+                            lastValidNumber = num;
+                        }
+                        groups.undo();
+                        board[i][j] = 0;
+
+                        //more than 1 numbers doesnt cause issues for the board
+                        if (validCount > 1) {
+                            break;
+                        }
+                    }
+
+                    //only one valid num
+                    if (validCount == 1) {
+                        if (fillCell(i, j, lastValidNumber)) {
+                            if (showIntermediateProcess) {
+                                cout << "Filled cell (" << i << "," << j << ") with " << lastValidNumber << endl;
+                                displayBoard();
+                            }
+            
+                            somethingFilled = true;
+                        }
+                    }
+                }
             }
         }
     }
-    findAndStoreGroups();
 }
 
-bool readBoardFromFile(const string& filename) {
-    ifstream file(filename);
-    if (!file) {
-        cout << "cant open file" << endl;
-        return false;
+//Packed corpus of many puzzles in one file, all numbers little endian:
+//  header  "FLMC", uint32 version, uint32 puzzle count, uint32 size of the name block
+//  index   per puzzle uint64 offset of its cells, uint32 offset of its name in the name block,
+//          uint16 height, uint16 width
+//  names   zero-terminated file names, then the cells of every puzzle, one byte each, row by row
+struct CorpusHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t namesSize;
+};
+
+struct CorpusEntry {
+    uint64_t cellsOffset;
+    uint32_t nameOffset;
+    uint16_t height;
+    uint16_t width;
+};
+
+static_assert(sizeof(CorpusHeader) == 16 && sizeof(CorpusEntry) == 16, "corpus layout has no padding");
+
+//Maps a corpus read-only and hands out pointers into it, boards are never copied on the way in
+class PuzzleCorpus {
+public:
+    PuzzleCorpus() {}
+    PuzzleCorpus(const PuzzleCorpus&) = delete;
+    PuzzleCorpus& operator=(const PuzzleCorpus&) = delete;
+    ~PuzzleCorpus() { close(); }
+
+    bool open(const string& path) {
+        close();
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data = static_cast<const uint8_t*>(mapped);
+                size = info.st_size;
+            }
+        }
+        ::close(fd);
+#else
+        ifstream file(path, ios::binary);
+        fallback.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        data = reinterpret_cast<const uint8_t*>(fallback.data());
+        size = fallback.size();
+#endif
+        if (!data || !checkLayout()) {
+            close();
+            return false;
+        }
+        return true;
     }
-    int height, width;
-    file >> height >> width;
-    Height = height;
-    Width = width;
-    board.clear();
-    board.resize(Height);
-    for (int i = 0; i < Height; i++) {
-        board[i].resize(Width, 0);
+
+    void close() {
+#ifndef _WIN32
+        if (data) munmap(const_cast<uint8_t*>(data), size);
+#else
+        fallback.clear();
+#endif
+        data = nullptr;
+        size = 0;
     }
-    globalGroups.clear();
 
-    fixedCells.clear();
-    for (int i = 0; i < Height; i++) {
-        for (int j = 0; j < Width; j++) {
-            file >> board[i][j];
+    size_t count() const { return data ? header()->count : 0; }
+    int height(size_t k) const { return entry(k).height; }
+    int width(size_t k) const { return entry(k).width; }
+    const Cell* cells(size_t k) const { return data + entry(k).cellsOffset; }
+    const char* name(size_t k) const { return reinterpret_cast<const char*>(names()) + entry(k).nameOffset; }
 
-            if (board[i][j] != 0) {
-                fixedCells.emplace_back(i, j, board[i][j]);
-                if (board[i][j] > maxNumOnBoard) {
-                    maxNumOnBoard = board[i][j];
-                }
+    bool load(size_t k, SolverContext& ctx) const { return ctx.loadBoard(height(k), width(k), cells(k)); }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    vector<char> fallback;
+#endif
+
+    const CorpusHeader* header() const { return reinterpret_cast<const CorpusHeader*>(data); }
+    const CorpusEntry& entry(size_t k) const {
+        return reinterpret_cast<const CorpusEntry*>(data + sizeof(CorpusHeader))[k];
+    }
+    const uint8_t* names() const { return data + sizeof(CorpusHeader) + count() * sizeof(CorpusEntry); }
+
+    //everything the accessors point to has to lie inside the file
+    bool checkLayout() const {
+        if (size < sizeof(CorpusHeader) || memcmp(header()->magic, "FLMC", 4) != 0 || header()->version != 1) {
+            return false;
+        }
+        uint64_t namesStart = sizeof(CorpusHeader) + (uint64_t)header()->count * sizeof(CorpusEntry);
+        uint64_t namesEnd = namesStart + header()->namesSize;
+        if (namesEnd > size || (header()->namesSize > 0 && data[namesEnd - 1] != 0)) return false;
+        for (size_t k = 0; k < count(); k++) {
+            const CorpusEntry& e = entry(k);
+            if (e.height == 0 || e.width == 0 || e.nameOffset >= header()->namesSize) return false;
+            uint64_t cells = (uint64_t)e.height * e.width;
+            if (e.cellsOffset < namesEnd || e.cellsOffset > size || cells > size - e.cellsOffset) return false;
+            //a cell equal to BORDER would look like the edge of the board to the solver
+            if (any_of(data + e.cellsOffset, data + e.cellsOffset + cells, [](Cell c) { return c >= BORDER; })) {
+                return false;
             }
         }
+        return true;
     }
+};
 
-    file.close();
-    findAndStoreGroups();
-    return true;
+//.txt puzzles of a directory, sorted by name
+vector<fs::path> puzzleFiles(const string& dir) {
+    vector<fs::path> files;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".txt") {
+            files.push_back(entry.path());
+        }
+    }
+    sort(files.begin(), files.end());
+    return files;
 }
 
-bool KeepCheckingSingleExits(){
-    bool changed = false;
-    pair<int, int> exitCell = {-1,-1};
-    int groupNumber = -1;
-
-    while(true){
-        exitCell = {-1,-1};
-        groupNumber = checkSingleExitGroups(exitCell);
-        if (groupNumber > 0){
-            if (!fillCell(exitCell.first, exitCell.second, groupNumber)){
-                cout << "error with filling the cell";
-            }
-            changed = true;
-            if(showIntermediateProcess){
-                cout << "Filled cell: " << "(" << exitCell.first << "," << exitCell.second << ")" << " with " << groupNumber <<endl;
-                displayBoard();
+//Collects puzzles in memory and writes them as one corpus file
+struct CorpusBuilder {
+    vector<CorpusEntry> entries;
+    string names;
+    vector<Cell> cells;
+
+    void add(const string& name, int height, int width, const Cell* board) {
+        entries.push_back({cells.size(), (uint32_t)names.size(), (uint16_t)height, (uint16_t)width});
+        names += name;
+        names += '\0';
+        cells.insert(cells.end(), board, board + height * width);
+    }
+
+    bool write(const string& corpusPath) {
+        CorpusHeader header = {{'F', 'L', 'M', 'C'}, 1, (uint32_t)entries.size(), (uint32_t)names.size()};
+        uint64_t cellsStart = sizeof(header) + entries.size() * sizeof(CorpusEntry) + names.size();
+        vector<CorpusEntry> index = entries;
+        for (auto& entry : index) {
+            entry.cellsOffset += cellsStart;
+        }
+
+        ofstream out(corpusPath, ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(CorpusEntry));
+        out.write(names.data(), names.size());
+        out.write(reinterpret_cast<const char*>(cells.data()), cells.size());
+        if (!out) {
+            cout << "Error writing " << corpusPath << endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+//packs every .txt puzzle of a directory into one corpus file
+bool packPuzzles(const string& dir, const string& corpusPath) {
+    vector<fs::path> files = puzzleFiles(dir);
+    CorpusBuilder corpus;
+    vector<Cell> cells;
+
+    SolverContext ctx;
+    for (const auto& file : files) {
+        if (!ctx.readBoardFromFile(file.string())) {
+            cout << "skipping " << file.string() << endl;
+            continue;
+        }
+        if (ctx.Height > UINT16_MAX || ctx.Width > UINT16_MAX) {
+            cout << "skipping " << file.string() << ", too big" << endl;
+            continue;
+        }
+        cells.clear();
+        for (int i = 0; i < ctx.Height; i++) {
+            for (int j = 0; j < ctx.Width; j++) {
+                cells.push_back(ctx.board[i][j]);
             }
         }
-        else{
-            break;
+        corpus.add(file.filename().string(), ctx.Height, ctx.Width, cells.data());
+    }
+
+    if (!corpus.write(corpusPath)) {
+        return false;
+    }
+    cout << "Packed " << corpus.entries.size() << "/" << files.size() << " puzzles into " << corpusPath << " ("
+         << fs::file_size(corpusPath) << " bytes)" << endl;
+    return corpus.entries.size() == files.size();
+}
+
+//The puzzles of a batch run, from a directory of .txt files or from a packed corpus file
+struct PuzzleSet {
+    vector<fs::path> files;
+    PuzzleCorpus corpus;
+    bool packed = false;
+
+    //a directory, a corpus or a single .txt puzzle
+    bool open(const string& path) {
+        if (fs::is_regular_file(path) && fs::path(path).extension() == ".txt") {
+            packed = false;
+            files = {path};
+            return true;
         }
+        packed = fs::is_regular_file(path);
+        if (packed) return corpus.open(path);
+        if (!fs::is_directory(path)) return false;
+        files = puzzleFiles(path);
+        return true;
     }
-    return changed;
+
+    size_t size() const { return packed ? corpus.count() : files.size(); }
+    string name(size_t k) const { return packed ? corpus.name(k) : files[k].filename().string(); }
+    bool load(size_t k, SolverContext& ctx) const {
+        return packed ? corpus.load(k, ctx) : ctx.readBoardFromFile(files[k].string());
+    }
+};
+
+//board number for result CSVs and exported SMT files: n for the HxWPBn baron files, otherwise the file name without extension
+string boardNumber(const fs::path& file) {
+    string stem = file.stem().string();
+    size_t pb = stem.find("PB");
+    return pb == string::npos ? stem : stem.substr(pb + 2);
 }
 
-bool KeepCheckingEmptyReachableCells(){
-    bool changed = false;
-    pair<int, int> whichCell = {-1,-1};
-    int groupNumber = -1;
-    while(true){
-        whichCell = {-1,-1};
-        groupNumber = checkIfEmptyCellCanBeReachedByOneNum(whichCell);
-        if (groupNumber > 0){
-            if (!fillCell(whichCell.first, whichCell.second, groupNumber)){
-                cout << "error with filling the cell";
+//what the SMT export deduces before writing the formula
+enum class ResidualMode {
+    None,     //the clues only
+    Standard, //applyAllDeterministicFilling, every region has a clue
+    Open      //fillSingleExitCellsAndSafeMoves, regions without clues are allowed
+};
+
+//exports every .txt puzzle in inputDir as {Height}x{Width}_{number}.txt in outputDir, on a pool of threads.
+//With a residual mode the board is filled as far as the strategies go first, every filled cell is pinned
+//and completed groups are left out of the formula.
+bool txtFilesToSMT(const string& inputDir, const string& outputDir, int threads,
+                   ResidualMode residual = ResidualMode::None) {
+    vector<fs::path> files = puzzleFiles(inputDir);
+    fs::create_directories(outputDir);
+
+    atomic<size_t> nextFile{0};
+    atomic<int> written{0};
+    atomic<size_t> fullBytes{0};
+    atomic<size_t> residualBytes{0};
+    atomic<long long> totalCells{0};
+    atomic<long long> closedCells{0};
+    mutex outputLock;
+
+    auto worker = [&]() {
+        SolverContext ctx;
+        ctx.options.strategySchedule = StrategySchedule::Fixed; //the same residual for any order of the files
+        FillominoSMTSolver solver;
+        vector<tuple<int, int, int>> pinned;
+        for (size_t k = nextFile++; k < files.size(); k = nextFile++) {
+            string fullPath = files[k].string();
+            if (!ctx.readBoardFromFile(fullPath)) {
+                lock_guard<mutex> guard(outputLock);
+                cerr << "Cant read: " << fullPath << endl;
+                continue;
             }
-            changed = true;
-            if(showIntermediateProcess){
-                cout << "Filled cell: " << "(" << whichCell.first << "," << whichCell.second << ")" << " with " << groupNumber <<endl;
-                displayBoard();
+
+            string name = to_string(ctx.Height) + "x" + to_string(ctx.Width) + "_" + boardNumber(files[k]) + ".txt";
+            string outPath = (fs::path(outputDir) / name).string();
+            FILE* outfile = fopen(outPath.c_str(), "wb");
+            if (!outfile) {
+                lock_guard<mutex> guard(outputLock);
+                cerr << "error with: " << outPath << endl;
+                continue;
             }
+
+            vector<int> closed;
+            if (residual != ResidualMode::None) {
+                SmtWriter counter;
+                solver.write(counter, ctx.Height, ctx.Width, ctx.fixedCells);
+                counter.flush();
+                fullBytes += counter.bytes;
+
+                if (residual == ResidualMode::Standard) ctx.applyAllDeterministicFilling();
+                else ctx.fillSingleExitCellsAndSafeMoves();
+                closed = ctx.completedGroupCells();
+
+                pinned.clear();
+                for (int i = 0; i < ctx.Height; i++) {
+                    for (int j = 0; j < ctx.Width; j++) {
+                        if (ctx.board[i][j] != 0) pinned.emplace_back(i, j, ctx.board[i][j]);
+                        closedCells += closed[i * ctx.Width + j] != 0;
+                    }
+                }
+                totalCells += ctx.Height * ctx.Width;
+            }
+
+            bool ok;
+            {
+                SmtWriter out(outfile);
+                if (residual == ResidualMode::None) solver.write(out, ctx.Height, ctx.Width, ctx.fixedCells);
+                else solver.write(out, ctx.Height, ctx.Width, pinned, closed);
+                ok = out.flush();
+                residualBytes += out.bytes;
+            }
+            ok = fclose(outfile) == 0 && ok;
+            if (!ok) {
+                lock_guard<mutex> guard(outputLock);
+                cerr << "error with: " << outPath << endl;
+                continue;
+            }
+            written++;
         }
-        else{
-            break;
-        }
+    };
+
+    vector<thread> pool;
+    for (int t = 0; t < threads; t++) {
+        pool.emplace_back(worker);
     }
-    return changed;
+    for (auto& t : pool) {
+        t.join();
+    }
+    cout << "SMT constraints for " << written << "/" << files.size() << " puzzles written to " << outputDir << endl;
+    if (residual != ResidualMode::None && fullBytes > 0) {
+        cout << "Residual formulas: " << residualBytes << " of " << fullBytes << " bytes ("
+             << 100.0 * residualBytes / fullBytes << "%), " << closedCells << " of " << totalCells
+             << " cells in completed groups" << endl;
+    }
+    return written == (int)files.size();
 }
 
-bool canGroupBeCompleted(Group& group) {
-    int currentGroupSize = group.cells.size();
-    int targetSize = group.number;
-    int requiredEmptyCells = targetSize - currentGroupSize;
-
-    if (requiredEmptyCells <= 0) {
-        return false;  // Group is already complete
+//Checks a directory of solver outputs named like the SMT export ({Height}x{Width}_{number}.txt) against
+//their puzzles in puzzleDir ({Height}x{Width}PB{number}.txt or {number}.txt), on a pool of threads
+bool checkSMTsolutions(const string& puzzleDir, const string& modelDir, int threads) {
+    vector<fs::path> models;
+    for (const auto& entry : fs::directory_iterator(modelDir)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".txt") {
+            models.push_back(entry.path());
+        }
     }
+    sort(models.begin(), models.end());
+
+    vector<char> accepted(models.size(), 0);
+    atomic<size_t> nextFile{0};
+    mutex outputLock;
+
+    auto worker = [&]() {
+        SolverContext ctx;
+        for (size_t k = nextFile++; k < models.size(); k = nextFile++) {
+            string stem = models[k].stem().string();
+            size_t underscore = stem.find('_');
+            fs::path puzzle = fs::path(puzzleDir) / (stem.substr(0, underscore) + "PB" + stem.substr(underscore + 1) + ".txt");
+            if (underscore == string::npos || !fs::exists(puzzle)) {
+                puzzle = fs::path(puzzleDir) / (stem.substr(underscore == string::npos ? 0 : underscore + 1) + ".txt");
+            }
 
-    // To store visited empty cells during BFS
-    std::vector<std::vector<bool>> visited(Height, std::vector<bool>(Width, false));
+            const char* problem = "no puzzle";
+            if (fs::exists(puzzle) && ctx.readBoardFromFile(puzzle.string())) {
+                problem = ctx.loadSMTmodel(models[k].string());
+            }
+            if (problem) {
+                lock_guard<mutex> guard(outputLock);
+                cout << problem << ": " << models[k].filename().string() << endl;
+                continue;
+            }
+            accepted[k] = 1;
+        }
+    };
 
+    vector<thread> pool;
+    for (int t = 0; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    for (auto& t : pool) {
+        t.join();
+    }
 
-    // BFS to check adjacent empty cells
-    queue<pair<int, int>> q;
+    size_t acceptedCount = count(accepted.begin(), accepted.end(), 1);
+    cout << acceptedCount << "/" << models.size() << " solver outputs are valid solutions" << endl;
+    return acceptedCount == models.size();
+}
 
-    for (const auto& cell : group.cells){
-        //put the cells from our group to true
-        visited[cell.first][cell.second] = true;
+//the text with quotes, backslashes and control characters escaped for a JSON string
+string jsonEscaped(const string& text) {
+    string escaped;
+    for (char c : text) {
+        if ((unsigned char)c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+            escaped += code;
+            continue;
+        }
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
     }
+    return escaped;
+}
 
-    // Enqueue all the boundary cells of the group to start BFS from
-    for (const auto& cell : group.cells) {
-        int row = cell.first;
-        int col = cell.second;
+//One line of JSON per puzzle. The stats object is left out when the counters are compiled out,
+//the solution (row by row) when it is empty.
+void writeStatsJson(ostream& out, const string& name, int height, int width, const string& status, double seconds,
+                    int maxDepth, long long nodes, [[maybe_unused]] const SolveStats& stats,
+                    const vector<int>& cells = {}) {
+    out << "{\"name\":\"" << jsonEscaped(name) << "\",\"size\":\"" << height << "x" << width << "\",\"status\":\"" << status
+        << "\",\"seconds\":" << seconds << ",\"maxDepth\":" << maxDepth << ",\"nodes\":" << nodes;
+#ifndef FLMSLV_NO_STATS
+    out << ",\"stats\":{\"reachabilityPasses\":" << stats.reachabilityPasses
+        << ",\"groupSizeCalls\":" << stats.groupSizeCalls << ",\"groupRebuilds\":" << stats.groupRebuilds
+        << ",\"completionChecks\":" << stats.completionChecks << ",\"singleExitFills\":" << stats.singleExitFills
+        << ",\"reachableFills\":" << stats.reachableFills << ",\"definitiveFills\":" << stats.definitiveFills
+        << ",\"singleExitNs\":" << stats.singleExitNs << ",\"reachableNs\":" << stats.reachableNs
+        << ",\"definitiveNs\":" << stats.definitiveNs << ",\"searchNodes\":" << stats.searchNodes
+        << ",\"failures\":" << stats.failures << ",\"backtracks\":" << stats.backtracks
+        << ",\"heapAllocations\":" << stats.heapAllocations << "}";
+#endif
+    //the solution, or for any other status the board as far as it got, so it can be handed to another solver
+    if (!cells.empty()) {
+        out << (status == "solved" ? ",\"solution\":[" : ",\"board\":[");
+        for (size_t k = 0; k < cells.size(); k++) {
+            out << (k ? "," : "") << cells[k];
+        }
+        out << "]";
+    }
+    out << "}\n";
+}
 
-        for (const auto& dir : DIRECTIONS) {
-            int newRow = row + dir[0];
-            int newCol = col + dir[1];
+struct BatchResult {
+    string name;
+    int height = 0;
+    int width = 0;
+    bool loaded = false;
+    bool solved = false;
+    string status;
+    string answeredBy;
+    int maxDepth = 0;
+    long long nodes = 0;
+    long long refutedHits = 0;
+    long long refutedMisses = 0;
+    long long kernelMismatches = 0;
+    double seconds = 0;
+    SolveStats stats;
+    vector<int> board; //as far as it was filled when not solved, for the JSON lines
+};
 
-            if (isValid(newRow, newCol) && !visited[newRow][newCol] && board[newRow][newCol] == 0) {
-                visited[newRow][newCol] = true;
-                q.push({newRow, newCol});
-            }
-        }
+//solves every .txt puzzle in a directory (or every puzzle of a packed corpus) on a pool of threads, each thread with its own context.
+//With a csvPath the times are also written in the columns of the z3 result files, with a jsonPath the
+//counters of every puzzle as JSON lines, with the partial board of the ones that were not solved.
+void batchSolve(const string& dir, int threads, const SolveOptions& options, const string& csvPath = "",
+                const string& jsonPath = "") {
+    PuzzleSet puzzles;
+    if (!puzzles.open(dir)) {
+        cout << "Can't open puzzles: " << dir << endl;
+        return;
     }
 
-    int emptyCellsFound = 0;
+    vector<BatchResult> results(puzzles.size());
+    atomic<size_t> nextFile{0};
 
-    while (!q.empty()) {
-        auto [row, col] = q.front();
-        q.pop();
+    auto worker = [&]() {
+        SolverContext ctx;
+        ctx.options = options;
+        for (size_t k = nextFile++; k < puzzles.size(); k = nextFile++) {
+            BatchResult& result = results[k];
+            result.name = puzzles.name(k);
+            if (!puzzles.load(k, ctx)) {
+                continue;
+            }
+            result.loaded = true;
+            result.height = ctx.Height;
+            result.width = ctx.Width;
+
+            ctx.resetStats();
+            auto start = chrono::steady_clock::now();
+            result.solved = ctx.solve();
+            result.status = ctx.statusName(result.solved);
+            result.answeredBy = ctx.answeredBy;
+            auto end = chrono::steady_clock::now();
+            result.seconds = chrono::duration<double>(end - start).count();
+            result.maxDepth = ctx.maxDepth;
+            result.nodes = ctx.nodes;
+            result.refutedHits = ctx.refutedHits;
+            result.refutedMisses = ctx.refutedMisses;
+            result.kernelMismatches = ctx.kernelMismatches;
+            result.stats = ctx.stats;
+            if (!jsonPath.empty() && !result.solved) {
+                for (int i = 0; i < ctx.Height; i++) {
+                    for (int j = 0; j < ctx.Width; j++) {
+                        result.board.push_back(ctx.board[i][j]);
+                    }
+                }
+            }
+        }
+    };
 
-        // If we've found enough empty cells, return true
-        if (++emptyCellsFound >= requiredEmptyCells) {
-            return true;
+    auto start = chrono::steady_clock::now();
+    vector<thread> pool;
+    for (int t = 0; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    for (auto& t : pool) {
+        t.join();
+    }
+    double wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    int solvedCount = 0;
+    long long totalNodes = 0;
+    long long mismatches = 0;
+    double cpuSeconds = 0;
+    for (const auto& result : results) {
+        if (!result.loaded) {
+            cout << result.name << " could not be read" << endl;
+            continue;
         }
+        mismatches += result.kernelMismatches;
+        cout << result.name << " " << result.status << ", maxDepth: " << result.maxDepth
+             << ", nodes: " << result.nodes << ", refuted hits/misses: " << result.refutedHits << "/"
+             << result.refutedMisses << ", time: " << result.seconds << "s"
+             << (result.answeredBy.empty() ? "" : ", answered by: " + result.answeredBy) << endl;
+        solvedCount += result.solved;
+        totalNodes += result.nodes;
+        cpuSeconds += result.seconds;
+    }
+    cout << "Solved " << solvedCount << "/" << results.size() << " puzzles on " << threads << " threads in "
+         << wallSeconds << "s (sum of solve times " << cpuSeconds << "s, " << totalNodes << " nodes)" << endl;
+    if (options.floodKernel == FloodKernel::Check) {
+        cout << "Flood kernels disagreed " << mismatches << " times" << endl;
+    }
 
-        for (const auto& dir : DIRECTIONS) {
-            int newRow = row + dir[0];
-            int newCol = col + dir[1];
+    if (!jsonPath.empty()) {
+        ofstream jsonFile(jsonPath);
+        for (const auto& result : results) {
+            if (!result.loaded) continue;
+            writeStatsJson(jsonFile, result.name, result.height, result.width, result.status,
+                           result.seconds, result.maxDepth, result.nodes, result.stats, result.board);
+        }
+        if (!jsonFile) cout << "Error writing " << jsonPath << endl;
+    }
 
-            //Instead of just checking empty cells, also check if we come across a same number, we could potentially merge with
-            //making it so we do have enough cells to complete to group
-            if (isValid(newRow, newCol) && !visited[newRow][newCol] && (board[newRow][newCol] == 0 || board[newRow][newCol] == group.number)) {
-                visited[newRow][newCol] = true;
-                q.push({newRow, newCol});
+    if (csvPath.empty()) return;
+    ofstream csvFile(csvPath);
+    if (!csvFile) {
+        cout << "Error opening " << csvPath << endl;
+        return;
+    }
+    csvFile << "Height,Width,Boardnum,TimeSeconds\n";
+    for (size_t k = 0; k < results.size(); k++) {
+        const BatchResult& result = results[k];
+        if (!result.loaded || !result.solved) continue;
+        csvFile << result.height << "," << result.width << "," << boardNumber(result.name) << "," << result.seconds
+                << "\n";
+    }
+}
+
+//counts the solutions of every puzzle in a directory or corpus up to limit, one puzzle per thread. A single
+//puzzle gets all threads, countSolutions then splits its search tree (with the backtracking engine).
+//Returns false when a puzzle could not be read or does not have exactly one solution.
+bool countPuzzles(const string& dir, int threads, long long limit, const SolveOptions& options) {
+    PuzzleSet puzzles;
+    if (!puzzles.open(dir)) {
+        cout << "Can't open puzzles: " << dir << endl;
+        return false;
+    }
+
+    struct CountResult {
+        bool loaded = false;
+        long long solutions = 0;
+        StopReason stopReason = StopReason::None;
+        long long nodes = 0;
+        double seconds = 0;
+    };
+    vector<CountResult> results(puzzles.size());
+    atomic<size_t> nextFile{0};
+    int searchThreads = puzzles.size() == 1 ? threads : 1;
+    if (puzzles.size() == 1) threads = 1;
+
+    auto worker = [&]() {
+        SolverContext ctx;
+        ctx.options = options;
+        for (size_t k = nextFile++; k < puzzles.size(); k = nextFile++) {
+            CountResult& result = results[k];
+            if (!puzzles.load(k, ctx)) {
+                continue;
             }
+            result.loaded = true;
+            ctx.resetStats();
+            auto start = chrono::steady_clock::now();
+            result.solutions = ctx.countSolutions(limit, searchThreads);
+            result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            result.stopReason = ctx.stopReason;
+            result.nodes = ctx.nodes;
         }
+    };
+
+    vector<thread> pool;
+    for (int t = 0; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    for (auto& t : pool) {
+        t.join();
     }
 
-    // Not enough adjacent empty cells to complete the group
-    return false;
+    int unique = 0, unsolvable = 0, multiple = 0, stopped = 0, unreadable = 0;
+    for (size_t k = 0; k < results.size(); k++) {
+        const CountResult& result = results[k];
+        cout << puzzles.name(k) << " ";
+        if (!result.loaded) {
+            cout << "could not be read" << endl;
+            unreadable++;
+            continue;
+        }
+        if (result.solutions >= limit) {
+            cout << "at least " << limit << " solutions";
+            multiple++;
+        } else if (result.stopReason != StopReason::None) {
+            cout << "stopped after " << result.solutions << " solutions";
+            stopped++;
+        } else if (result.solutions == 1) {
+            cout << "unique";
+            unique++;
+        } else if (result.solutions == 0) {
+            cout << "no solution";
+            unsolvable++;
+        } else {
+            cout << result.solutions << " solutions";
+            multiple++;
+        }
+        cout << ", nodes: " << result.nodes << ", time: " << result.seconds << "s" << endl;
+    }
+    cout << "Unique " << unique << "/" << results.size() << ", several solutions " << multiple << ", no solution "
+         << unsolvable << ", stopped " << stopped << ", unreadable " << unreadable << endl;
+    if (options.engine != Engine::Sat) {
+        cout << "Counted with the native search, it only sees solutions where every region holds a clue" << endl;
+    }
+    return unique == (int)results.size();
 }
 
-void checkIncompleteGroups() {
-    findAndStoreGroups();
+enum class Difficulty {Any, Easy, Hard};
+
+struct GeneratorOptions {
+    int height = 10;
+    int width = 10;
+    int maxNumber = DEFAULT_MAX_NUM; //largest region
+    long long count = 100;
+    uint64_t seed = 1;
+    Difficulty difficulty = Difficulty::Any; //easy: no branching needed, hard: the search has to branch
+    string outDir;     //one HxWPGn.txt file per puzzle
+    string corpusPath; //or all of them in one corpus
+};
 
-    for (auto& group : globalGroups) {
-        if (group.cells.size() < group.number) {
-            // The group is incomplete, check if it can be completed
-            bool canBeCompleted = canGroupBeCompleted(group);
+//Makes puzzles with exactly one solution (among the boards with numbers up to maxNumber, regions without
+//a clue included). A random valid partition is written out in full, then clues are removed in random order
+//as long as the puzzle stays unique. Every removal is checked on one FillominoSatSolver per partition, the
+//clues go in as assumptions, so learnt clauses and region refinements carry over from check to check.
+class PuzzleGenerator {
+public:
+    long long checks = 0;   //uniqueness checks
+    long long rejected = 0; //puzzles thrown away for their difficulty
 
-            cout << "Checking Group " << group.number << " with cells: ";
-            for (const auto& cell : group.cells) {
-                cout << "(" << cell.first << "," << cell.second << ") ";
-            }
-            cout << endl;
+    explicit PuzzleGenerator(const GeneratorOptions& options) : options(options) {
+        //the difficulty of a puzzle must not depend on the puzzles before it
+        ctx.options.strategySchedule = StrategySchedule::Fixed;
+    }
 
-            if (canBeCompleted) {
-                cout << "Group " << group.number << " can be completed." << endl;
-            } else {
-                cout << "Group " << group.number << " cannot be completed." << endl;
-            }
+    static const int MAX_ATTEMPTS = 10000; //partitions tried for one puzzle before giving up
+
+    //puzzle k of the run, the same for every thread count. False when no partition or no puzzle of the
+    //wanted difficulty turned up within MAX_ATTEMPTS tries.
+    bool generate(long long k, vector<Cell>& puzzle) {
+        rng.seed(mixHash(options.seed ^ mixHash(k)));
+        for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+            if (!randomPartition()) continue;
+            puzzle = solution;
+            removeClues(puzzle);
+            if (options.difficulty != Difficulty::Hard) return true;
+
+            ctx.loadBoard(options.height, options.width, puzzle.data());
+            ctx.resetStats();
+            ctx.countSolutions(1);
+            if (ctx.nodes > 1) return true;
+            rejected++;
         }
+        return false;
     }
-}
 
-bool canAllGroupsBeCompleted(){
-    findAndStoreGroups();
-    for (auto& group : globalGroups) {
-        if (group.cells.size() < group.number){
-            //there is at least one group that cannot be completed
-            if(!canGroupBeCompleted(group)){
-                return false;
+private:
+    GeneratorOptions options;
+    mt19937_64 rng;
+    SolverContext ctx; //the native search, for the difficulty
+    vector<Cell> solution;
+    vector<int> region; //region id of every cell of the solution
+    vector<int> order;
+
+    int randomInt(int low, int high) { return uniform_int_distribution<int>(low, high)(rng); }
+
+    bool touches(int cell, Cell number) const {
+        int i = cell / options.width, j = cell % options.width;
+        for (auto [di, dj] : DIRECTIONS) {
+            int ni = i + di, nj = j + dj;
+            if (ni >= 0 && ni < options.height && nj >= 0 && nj < options.width &&
+                solution[ni * options.width + nj] == number) {
+                return true;
             }
         }
+        return false;
     }
 
-    //all groups can be completed
-    return true;
-}
-
-int findDefinitiveNumber(pair<int, int> &defCell) {
-    for (int i = 0; i < Height; i++) {
-        for (int j = 0; j < Width; j++) {
-            if (board[i][j] == 0) { // Empty cell found
-                set<int> possibleNumbers;
-                
-                // Find numbers that can reach this cell
-                for (int number = 2; number <= maxNumOnBoard; number++) {
-                    for (int x = 0; x < Height; x++) {
-                        for (int y = 0; y < Width; y++) {
-                            if (board[x][y] == number && canReach(x, y, i, j, number)) {
-                                possibleNumbers.insert(number);
-                                break; // No need to check further for this number
+    //Grows the regions one after the other from random cells. A region never grows next to a region of
+    //its target size; when it gets stuck below the target its actual size must not touch an equal region
+    //either, else another target is tried. False when a cell could not be covered at all.
+    bool randomPartition() {
+        int cells = options.height * options.width;
+        solution.assign(cells, 0);
+        region.assign(cells, -1);
+        order.resize(cells);
+        iota(order.begin(), order.end(), 0);
+        shuffle(order.begin(), order.end(), rng);
+
+        vector<int> members, frontier;
+        int regions = 0;
+        for (int start : order) {
+            if (solution[start] != 0) continue;
+            bool placed = false;
+            for (int attempt = 0; attempt < 16 && !placed; attempt++) {
+                int target = randomInt(1, options.maxNumber);
+                if (touches(start, target)) continue;
+
+                members = {start};
+                region[start] = regions;
+                while ((int)members.size() < target) {
+                    frontier.clear();
+                    for (int cell : members) {
+                        int i = cell / options.width, j = cell % options.width;
+                        for (auto [di, dj] : DIRECTIONS) {
+                            int ni = i + di, nj = j + dj;
+                            if (ni < 0 || ni >= options.height || nj < 0 || nj >= options.width) continue;
+                            int next = ni * options.width + nj;
+                            if (solution[next] == 0 && region[next] != regions && !touches(next, target)) {
+                                frontier.push_back(next);
                             }
                         }
                     }
+                    if (frontier.empty()) break;
+                    int next = frontier[randomInt(0, frontier.size() - 1)];
+                    region[next] = regions;
+                    members.push_back(next);
                 }
-                
-                int validCount = 0;
-                int lastValidNumber = -1;
-                // Test filling the cell with each possible number
-                for (int num : possibleNumbers) {
-                    board[i][j] = num; // Temporarily place the number
-                    if (canAllGroupsBeCompleted() && !existsOverfilledGroup()) {
-                        validCount++;
-                        lastValidNumber = num;
-                    }
-                    board[i][j] = 0; // Revert change
-                    
-                    if (validCount > 1){
-                        break; // If more than 1 number is valid, move to next cell
-                    }
-                        
+
+                Cell size = members.size();
+                placed = true;
+                for (int cell : members) {
+                    if (touches(cell, size)) placed = false;
                 }
-                
-                // If exactly one valid number was found, fill it in permanently
-                if (validCount == 1) {
-                    defCell.first = i;
-                    defCell.second = j;
-                    return lastValidNumber;
+                for (int cell : members) {
+                    if (placed) solution[cell] = size;
+                    else region[cell] = -1;
                 }
             }
+            if (!placed) return false;
+            regions++;
         }
+        return true;
     }
 
-    //No cell found where we can figure out a possible definitive number.
-    return -1;
-}
+    //Removes clues in random order, keeping one per region so the native search can still solve the puzzle.
+    //Without the clue of cell the puzzle stays unique unless some solution puts another number there: any
+    //other solution that agrees on cell was a solution before the removal too.
+    void removeClues(vector<Cell>& puzzle) {
+        int regions = *max_element(region.begin(), region.end()) + 1;
+        vector<int> clues(regions, 0);
+        for (int cell = 0; cell < (int)puzzle.size(); cell++) {
+            clues[region[cell]]++;
+        }
+        shuffle(order.begin(), order.end(), rng);
+
+        FillominoSatSolver sat;
+        sat.encode(options.height, options.width, options.maxNumber);
+        vector<int> found;
+        for (int cell : order) {
+            if (clues[region[cell]] == 1) continue;
+            puzzle[cell] = 0;
+
+            vector<int>& assumptions = sat.sat.assumptions;
+            assumptions = {sat.cellLit(cell, solution[cell], true)};
+            for (int other = 0; other < (int)puzzle.size(); other++) {
+                if (puzzle[other] != 0) assumptions.push_back(sat.cellLit(other, puzzle[other]));
+            }
+            checks++;
+            if (sat.next(found) != 0 ||
+                (options.difficulty == Difficulty::Easy && !solvedWithoutBranching(puzzle))) {
+                puzzle[cell] = solution[cell];
+                continue;
+            }
+            clues[region[cell]]--;
+        }
+    }
 
-bool keepFillingDefinitiveNumbers(){
-    bool changed = false;
-    pair<int, int> defCell;
-    int defNumber;
-    while (true)
-    {
-        defCell = {-1, -1};
-        defNumber = findDefinitiveNumber(defCell);
-        if (defNumber == -1) {
-            //no more definitive numbers can be found
-            break;
+    bool solvedWithoutBranching(const vector<Cell>& puzzle) {
+        ctx.loadBoard(options.height, options.width, puzzle.data());
+        ctx.resetStats();
+        return ctx.countSolutions(1) == 1 && ctx.nodes == 1;
+    }
+};
+
+//Writes the puzzles of a generator run one by one in the order of k. They all have the same size and are
+//named HxWPGn.txt, so the index and the names of a corpus are known up front and go out before the first
+//board, whose cells then follow one after the other.
+class GeneratedPuzzleWriter {
+public:
+    explicit GeneratedPuzzleWriter(const GeneratorOptions& options)
+        : options(options), cells(options.height * options.width),
+          prefix(to_string(options.height) + "x" + to_string(options.width) + "PG") {}
+
+    bool open() {
+        if (!options.outDir.empty()) fs::create_directories(options.outDir);
+        if (options.corpusPath.empty()) return true;
+
+        uint64_t namesSize = 0;
+        for (long long k = 0; k < options.count; k++) {
+            namesSize += name(k).size() + 1;
+        }
+        if (options.count > UINT32_MAX || namesSize > UINT32_MAX || options.height > UINT16_MAX ||
+            options.width > UINT16_MAX) {
+            cout << "Too many or too big puzzles for a corpus" << endl;
+            return false;
         }
-        if (!fillCell(defCell.first, defCell.second, defNumber)) {
-            cout << "Error filling cell (" << defCell.first << ", " << defCell.second << ") with " << defNumber << endl;
+
+        corpus.open(options.corpusPath, ios::binary);
+        CorpusHeader header = {{'F', 'L', 'M', 'C'}, 1, (uint32_t)options.count, (uint32_t)namesSize};
+        corpus.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        uint64_t cellsStart = sizeof(header) + options.count * sizeof(CorpusEntry) + namesSize;
+        uint32_t nameOffset = 0;
+        for (long long k = 0; k < options.count; k++) {
+            CorpusEntry entry = {cellsStart + k * cells, nameOffset, (uint16_t)options.height, (uint16_t)options.width};
+            corpus.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+            nameOffset += name(k).size() + 1;
         }
-        changed = true;
-        
-        if (showIntermediateProcess) {
-            //cout << "Filled cell: (" << defCell.first << ", " << defCell.second << ") with " << defNumber << endl;
-            //displayBoard();
+        for (long long k = 0; k < options.count; k++) {
+            string text = name(k);
+            corpus.write(text.c_str(), text.size() + 1);
         }
+        if (!corpus) cout << "Error writing " << options.corpusPath << endl;
+        return bool(corpus);
     }
-    return changed;
-}
 
-void applyAllDeterministicFilling() {
-    bool overallChanged;
-
-    do {
-        overallChanged = false;
-        bool easyStratsChanged;
-        do {
-            easyStratsChanged = false;
-            if (KeepCheckingSingleExits()){
-                easyStratsChanged = true;
-            }
-            if (KeepCheckingEmptyReachableCells()){
-                easyStratsChanged = true;
+    //puzzle k, after every puzzle before it
+    bool write(long long k, const Cell* puzzle) {
+        if (!options.outDir.empty()) {
+            ofstream file(fs::path(options.outDir) / name(k));
+            file << options.height << " " << options.width << "\n";
+            for (int i = 0; i < options.height; i++) {
+                for (int j = 0; j < options.width; j++) {
+                    file << (int)puzzle[i * options.width + j] << (j + 1 < options.width ? " " : "\n");
+                }
             }
-            if (easyStratsChanged){
-                overallChanged = true;
+            if (!file) {
+                cout << "Error writing to " << options.outDir << endl;
+                return false;
             }
-        } while (easyStratsChanged);
-
-        if (keepFillingDefinitiveNumbers()) {
-            overallChanged = true;
         }
+        if (corpus.is_open() && !corpus.write(reinterpret_cast<const char*>(puzzle), cells)) {
+            cout << "Error writing " << options.corpusPath << endl;
+            return false;
+        }
+        return true;
+    }
 
-    } while (overallChanged);
-}
-
-bool solveWithBacktracking(int currentDepth = 0) {
-    if ((showDepth || depthExperiment) && currentDepth > maxDepth) {
-        maxDepth = currentDepth;
+    bool close() {
+        if (!corpus.is_open()) return true;
+        corpus.close();
+        return bool(corpus);
     }
 
-    applyAllDeterministicFilling();
+private:
+    const GeneratorOptions& options;
+    int cells;
+    string prefix;
+    ofstream corpus;
 
-    if (existsOverfilledGroup() || !canAllGroupsBeCompleted()) {
+    string name(long long k) const { return prefix + to_string(k + 1) + ".txt"; }
+};
+
+//Generates options.count puzzles on a pool of threads and reports the throughput. Puzzle k only depends on
+//the seed and k, so a run can be repeated with any number of threads. Puzzles are written as soon as all
+//before them are done; a worker does not start a puzzle more than a window ahead of the oldest unfinished
+//one, so memory stays the same for any count.
+bool generatePuzzles(const GeneratorOptions& options, int threads) {
+    if (options.outDir.empty() && options.corpusPath.empty()) {
+        cout << "No output, give --out or --corpus" << endl;
+        return false;
+    }
+    int cells = options.height * options.width;
+    if (cells <= 0 || options.maxNumber < 1 || options.maxNumber >= BORDER) {
+        cout << "Bad board size or number range" << endl;
+        return false;
+    }
+    if (cells > 1 && options.maxNumber < 2) {
+        //regions of 1 can not touch, so a board of more than one cell needs bigger regions
+        cout << "Boards of more than one cell need --max-number 2 or more" << endl;
         return false;
     }
 
-    if (allGroupsAreExactlyFilled()) {
-        return true;
+    GeneratedPuzzleWriter writer(options);
+    if (!writer.open()) return false;
+
+    atomic<long long> nextPuzzle{0};
+    atomic<long long> checks{0}, rejected{0};
+    bool failed = false; //guarded by outputLock, like everything below
+    bool gaveUp = false;
+    mutex outputLock;
+    condition_variable progress;
+    map<long long, vector<Cell>> done; //finished puzzles that wait for an older one
+    long long nextToWrite = 0;
+    long long clues = 0;
+    const long long window = 16LL * threads;
+    auto start = chrono::steady_clock::now();
+
+    auto worker = [&]() {
+        PuzzleGenerator generator(options);
+        vector<Cell> puzzle;
+        for (long long k = nextPuzzle++; k < options.count; k = nextPuzzle++) {
+            {
+                unique_lock<mutex> guard(outputLock);
+                progress.wait(guard, [&]() { return failed || k < nextToWrite + window; });
+                if (failed) break;
+            }
+            bool generated = generator.generate(k, puzzle);
+
+            lock_guard<mutex> guard(outputLock);
+            if (!generated) {
+                failed = gaveUp = true;
+                progress.notify_all();
+                break;
+            }
+            done.emplace(k, puzzle);
+            for (auto next = done.begin(); !failed && next != done.end() && next->first == nextToWrite;
+                 next = done.erase(next)) {
+                failed = !writer.write(nextToWrite, next->second.data());
+                clues += count_if(next->second.begin(), next->second.end(), [](Cell c) { return c != 0; });
+                nextToWrite++;
+            }
+            progress.notify_all();
+        }
+        checks += generator.checks;
+        rejected += generator.rejected;
+    };
+    vector<thread> pool;
+    for (int t = 0; t < threads; t++) {
+        pool.emplace_back(worker);
     }
+    for (auto& t : pool) {
+        t.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (gaveUp) {
+        cout << "Gave up after " << PuzzleGenerator::MAX_ATTEMPTS << " attempts at one puzzle, the board may be too small"
+             << " for the number range or the difficulty" << endl;
+    }
+    if (!writer.close() || failed) return false;
 
-    auto boardBackup = board;
-    vector<Group> groupsBackup = globalGroups;
+    cout << "Generated " << options.count << " " << options.height << "x" << options.width << " puzzles on "
+         << threads << " threads in " << seconds << "s (" << options.count / seconds << " puzzles/s), "
+         << (options.count ? (double)clues / options.count : 0) << " clues on average, " << checks
+         << " uniqueness checks, " << rejected << " rejected for difficulty" << endl;
+    return true;
+}
 
-    for (int i = 0; i < Height; i++) {
-        for (int j = 0; j < Width; j++) {
-            if (board[i][j] != 0) continue;
+struct BenchOptions {
+    int repeat = 5;
+    int warmup = 1;
+    string csvPath;
+    string jsonPath;
+    string comparePath;
+    double thresholdPercent = 10; //slowdown of a board size that counts as a regression
+};
 
-            bool triedSomething = false;
+struct BenchResult {
+    string name;
+    int height = 0;
+    int width = 0;
+    string status = "unread"; //solved, unsolved, timeout or unread
+    int maxDepth = 0;
+    long long nodes = 0;
+    vector<long long> runNs;
+    long long minNs = 0;
+    long long medianNs = 0;
+    long long p95Ns = 0;
+    SolveStats stats; //of the last run
+};
 
-            for (int num = 2; num <= maxNumOnBoard; num++) {
-                bool reachable = false;
+//nearest rank percentile of sorted times
+long long percentileNs(const vector<long long>& sorted, double percent) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)ceil(percent / 100 * sorted.size());
+    return sorted[min(sorted.size(), max<size_t>(rank, 1)) - 1];
+}
 
-                for (int x = 0; x < Height && !reachable; x++) {
-                    for (int y = 0; y < Width && !reachable; y++) {
-                        if (board[x][y] == num && canReach(x, y, i, j, num)) {
-                            reachable = true;
-                        }
-                    }
-                }
+//seconds per board of one result CSV, keyed by height, width and board number
+struct BenchTimes {
+    map<tuple<int, int, string>, double> seconds;
+};
 
-                if (!reachable) continue;
+//Numbers of the command line and the result CSVs: the whole text has to be one number in range. stoi
+//and friends would throw on "abc" and accept "12abc".
+bool parseInteger(const string& text, long long& value) {
+    char* end;
+    errno = 0;
+    value = strtoll(text.c_str(), &end, 10);
+    return !text.empty() && *end == '\0' && errno == 0;
+}
 
-                triedSomething = true;
-                board[i][j] = num;
-                findAndStoreGroups();
+bool parseInteger(const string& text, int& value) {
+    long long wide;
+    if (!parseInteger(text, wide) || wide < INT_MIN || wide > INT_MAX) return false;
+    value = wide;
+    return true;
+}
 
-                if (solveWithBacktracking(currentDepth + 1)) {
-                    return true;
-                }
+bool parseUnsigned(const string& text, uint64_t& value) {
+    char* end;
+    errno = 0;
+    value = strtoull(text.c_str(), &end, 10);
+    return !text.empty() && text[0] != '-' && *end == '\0' && errno == 0;
+}
 
-                // Backtrack
-                board = boardBackup;
-                globalGroups = groupsBackup;
-            }
+bool parseDecimal(const string& text, double& value) {
+    char* end;
+    errno = 0;
+    value = strtod(text.c_str(), &end);
+    return !text.empty() && *end == '\0' && errno == 0 && isfinite(value);
+}
 
-            if (showDepth && triedSomething) {
-                int depthGap = maxDepth - currentDepth;
-                depthGapHistogram[depthGap]++;
-            }
+//Reads a result CSV. Columns are found by name, so the bench output, baronDeterBackResult.csv (time_s)
+//and the z3 result files (TimeSeconds) can all be compared with each other.
+bool readBenchTimes(const string& path, BenchTimes& times) {
+    ifstream file(path);
+    string line;
+    if (!file || !getline(file, line)) {
+        cout << "Can't read " << path << endl;
+        return false;
+    }
 
-            return false;
+    auto split = [](const string& text) {
+        vector<string> fields;
+        stringstream stream(text);
+        string field;
+        while (getline(stream, field, ',')) {
+            while (!field.empty() && (field.back() == '\r' || field.back() == ' ')) field.pop_back();
+            fields.push_back(field);
         }
+        return fields;
+    };
+
+    vector<string> header = split(line);
+    int heightColumn = -1, widthColumn = -1, boardColumn = -1, timeColumn = -1;
+    for (int k = 0; k < (int)header.size(); k++) {
+        string name = header[k];
+        transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (name == "height") heightColumn = k;
+        else if (name == "width") widthColumn = k;
+        else if (name == "boardnum") boardColumn = k;
+        else if (name == "time_s" || name == "timeseconds") timeColumn = k;
+    }
+    if (min({heightColumn, widthColumn, boardColumn, timeColumn}) < 0) {
+        cout << path << " needs height, width, boardnum and time_s columns" << endl;
+        return false;
     }
 
-    return false;
+    while (getline(file, line)) {
+        vector<string> fields = split(line);
+        if ((int)fields.size() <= max({heightColumn, widthColumn, boardColumn, timeColumn})) continue;
+        //janko numbers are written as 007 or 7 depending on the tool
+        string board = fields[boardColumn];
+        board.erase(0, min(board.find_first_not_of('0'), board.size() - 1));
+        int height, width;
+        double seconds;
+        if (!parseInteger(fields[heightColumn], height) || !parseInteger(fields[widthColumn], width) ||
+            !parseDecimal(fields[timeColumn], seconds)) continue;
+        times.seconds[{height, width, board}] = seconds;
+    }
+    return true;
 }
 
-//finds moves for the challenging version of the game, where you can create new groups
-void fillSingleExitCellsAndSafeMoves() {
-    bool somethingFilled = true; //track if any cell is filled
-    pair<int, int> exitcell = {-1, -1};
-    while (somethingFilled) {
-        somethingFilled = false;
-        int groupNumber = checkSingleExitGroups(exitcell);  //check if there exists a group with a single exit
-        if (groupNumber != -1) {  //check if such group was found
-            int row = exitcell.first;
-            int col = exitcell.second;
+//Compares two result CSVs per board size over the boards both contain. Returns false if a size got
+//slower by more than the threshold.
+bool compareBenchRuns(const string& oldPath, const string& newPath, double thresholdPercent) {
+    BenchTimes before, after;
+    if (!readBenchTimes(oldPath, before) || !readBenchTimes(newPath, after)) return false;
+
+    map<pair<int, int>, tuple<int, double, double>> sizes; //boards, old seconds, new seconds
+    for (const auto& [key, oldSeconds] : before.seconds) {
+        auto found = after.seconds.find(key);
+        if (found == after.seconds.end()) continue;
+        auto& [boards, oldSum, newSum] = sizes[{get<0>(key), get<1>(key)}];
+        boards++;
+        oldSum += oldSeconds;
+        newSum += found->second;
+    }
 
-            //fill the group
-            if (fillCell(row, col, groupNumber)) {
-                if (showIntermediateProcess) {
-                    cout << "Filled single exit cell (" << row << "," << col << ") with " << groupNumber << endl;
-                    displayBoard();
+    bool regressed = false;
+    cout << "size     boards    old (s)    new (s)   change" << endl;
+    for (const auto& [size, sums] : sizes) {
+        auto [boards, oldSum, newSum] = sums;
+        double change = oldSum > 0 ? 100 * (newSum - oldSum) / oldSum : 0;
+        bool slower = change > thresholdPercent;
+        regressed = regressed || slower;
+
+        char row[128];
+        snprintf(row, sizeof(row), "%3dx%-3d  %6d  %9.4f  %9.4f  %+7.1f%%%s", size.first, size.second, boards, oldSum,
+                 newSum, change, slower ? "  REGRESSION" : "");
+        cout << row << endl;
+    }
+    if (sizes.empty()) cout << "no boards in common" << endl;
+    return !regressed;
+}
+
+//Times every puzzle of the given directories or corpus files, one puzzle at a time on one thread.
+//Each puzzle is loaded fresh for every run and only the solve is timed. Writes the columns of
+//baronDeterBackResult.csv (time_s is the median) followed by min, p95, runs and status.
+bool benchmark(const vector<string>& sources, const SolveOptions& options, const BenchOptions& bench) {
+    vector<BenchResult> results;
+    SolverContext ctx;
+    ctx.options = options;
+
+    for (const string& source : sources) {
+        PuzzleSet puzzles;
+        if (!puzzles.open(source)) {
+            cout << "Can't open puzzles: " << source << endl;
+            return false;
+        }
+        for (size_t k = 0; k < puzzles.size(); k++) {
+            BenchResult result;
+            result.name = puzzles.name(k);
+
+            for (int run = 0; run < bench.warmup + bench.repeat; run++) {
+                //every run starts without the strategy history of earlier boards, so maxdepth and nodes do not
+                //depend on which puzzles came before
+                ctx.scheduler = StrategyScheduler();
+                if (!puzzles.load(k, ctx)) break;
+                result.height = ctx.Height;
+                result.width = ctx.Width;
+
+                ctx.resetStats();
+                auto start = chrono::steady_clock::now();
+                bool solved = ctx.solve();
+                auto end = chrono::steady_clock::now();
+
+                result.status = ctx.statusName(solved);
+                result.maxDepth = ctx.maxDepth;
+                result.nodes = ctx.nodes;
+                result.stats = ctx.stats;
+                if (run >= bench.warmup) {
+                    result.runNs.push_back(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
                 }
-                somethingFilled = true;
+                if (ctx.stopReason != StopReason::None) break; //another run would only stop again
+            }
+
+            vector<long long> sorted = result.runNs;
+            sort(sorted.begin(), sorted.end());
+            if (!sorted.empty()) {
+                result.minNs = sorted.front();
+                result.medianNs = percentileNs(sorted, 50);
+                result.p95Ns = percentileNs(sorted, 95);
             }
+            cout << result.name << " " << result.status << ", maxDepth: " << result.maxDepth
+                 << ", nodes: " << result.nodes << ", min/median/p95: " << result.minNs << "/" << result.medianNs
+                 << "/" << result.p95Ns << " ns over " << result.runNs.size() << " runs"
+#ifndef FLMSLV_NO_STATS
+                 << ", allocations: " << result.stats.heapAllocations
+#endif
+                 << endl;
+            results.push_back(result);
         }
-        if (!somethingFilled) {
-            for (int i = 0; i < Height; i++) {
-                for (int j = 0; j < Width; j++) {
-                    if (board[i][j] != 0){
-                        continue;
-                    }
+    }
 
-                    int validCount = 0;
-                    int lastValidNumber = -1;
-                    for (int num = 1; num <= maxNumOnBoard; num++) {
-                        board[i][j] = num;
-                        if (canAllGroupsBeCompleted() && !existsOverfilledGroup()) {
-                            validCount++;
-                            lastValidNumber = num;
-                        }
-                        board[i][j] = 0;
+    int solvedCount = 0;
+    long long medianSum = 0;
+    long long allocations = 0;
+    for (const auto& result : results) {
+        solvedCount += result.status == "solved";
+        medianSum += result.medianNs;
+        allocations += result.stats.heapAllocations;
+    }
+    cout << "Solved " << solvedCount << "/" << results.size() << " puzzles, sum of medians "
+         << medianSum / 1e9 << "s"
+#ifndef FLMSLV_NO_STATS
+         << ", " << allocations << " heap allocations in the last runs"
+#endif
+         << endl;
+
+    if (!bench.jsonPath.empty()) {
+        ofstream jsonFile(bench.jsonPath);
+        for (const auto& result : results) {
+            if (result.status == "unread") continue;
+            writeStatsJson(jsonFile, result.name, result.height, result.width, result.status, result.medianNs / 1e9,
+                           result.maxDepth, result.nodes, result.stats);
+        }
+        if (!jsonFile) cout << "Error writing " << bench.jsonPath << endl;
+    }
 
-                        //more than 1 numbers doesnt cause issues for the board
-                        if (validCount > 1) {
-                            break;
-                        }
-                    }
+    if (bench.csvPath.empty()) return true;
+    ofstream csvFile(bench.csvPath);
+    if (!csvFile) {
+        cout << "Error opening " << bench.csvPath << endl;
+        return false;
+    }
+    csvFile << "height,width,boardnum,maxdepth,time_s,min_s,p95_s,runs,status\n";
+    char seconds[64];
+    for (const auto& result : results) {
+        if (result.status == "unread") continue;
+        snprintf(seconds, sizeof(seconds), "%.9f,%.9f,%.9f", result.medianNs / 1e9, result.minNs / 1e9,
+                 result.p95Ns / 1e9);
+        csvFile << result.height << "," << result.width << "," << boardNumber(result.name) << ","
+                << result.maxDepth << "," << seconds << "," << result.runNs.size() << "," << result.status << "\n";
+    }
+    csvFile.close();
 
-                    //only one valid num
-                    if (validCount == 1) {
-                        if (fillCell(i, j, lastValidNumber)) {
-                            if (showIntermediateProcess) {
-                                cout << "Filled cell (" << i << "," << j << ") with " << lastValidNumber << endl;
-                                displayBoard();
-                            }
-            
-                            somethingFilled = true;
-                        }
-                    }
-                }
-            }
+    if (bench.comparePath.empty()) return true;
+    return compareBenchRuns(bench.comparePath, bench.csvPath, bench.thresholdPercent);
+}
+
+//reads one line without the line break, false at the end of the input
+bool readLine(FILE* in, string& line) {
+    line.clear();
+    char chunk[4096];
+    while (fgets(chunk, sizeof(chunk), in)) {
+        line += chunk;
+        if (line.back() == '\n') {
+            line.pop_back();
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            return true;
         }
     }
+    return !line.empty();
 }
 
-void txtFilesToSMT() {
+//Request lines of the solve service: <id> <height> <width> <height * width cells, 0 for empty>.
+//Every request is answered with one JSON line holding the id as name, the status ("solved", "unsolved",
+//"timeout", "unknown" or "error"), the stats and the board row by row: the solution when solved, otherwise
+//as far as the solver filled it before it stopped. With several threads the
+//answers can come back in a different order than the requests, the id tells them apart.
+class SolveService {
+public:
+    SolveService(int threads, const SolveOptions& options) : contexts(threads) {
+        for (auto& ctx : contexts) {
+            ctx.options = options;
+        }
+    }
 
-    string inputDir = "C:\\Users\\Ryan\\Desktop\\baronPuzzles\\";
-    string outputDir = "C:\\Users\\Ryan\\Desktop\\baronSMTs\\";
+    //answers every request from in on out until in ends. The contexts stay warm from one stream to the next.
+    //false when the answers could not be written, the client went away.
+    bool serve(FILE* in, FILE* out) {
+        output = out;
+        finished = false;
+        writeFailed = false;
 
-    for (const auto& entry : fs::directory_iterator(inputDir)) {
-        if (entry.path().extension() == ".txt") {
-            string filename = entry.path().filename().string();
-            size_t xPos = filename.find('x');
-            size_t pbPos = filename.find("PB");
-            size_t dotPos = filename.find('.');
+        vector<thread> pool;
+        for (size_t id = 0; id < contexts.size(); id++) {
+            pool.emplace_back([this, id]() { work(contexts[id]); });
+        }
 
-            if (xPos == string::npos || pbPos == string::npos || dotPos == string::npos) {
-                cerr << "Bad file format: " << filename << endl;
-                continue;
+        //requests queue up while the workers solve, so a client can send many before reading answers
+        string line;
+        while (!writeFailed && readLine(in, line)) {
+            if (line.find_first_not_of(" \t") == string::npos) continue;
+            unique_lock<mutex> guard(queueLock);
+            queueSpace.wait(guard, [&]() { return pending.size() < 64 * contexts.size(); });
+            pending.push_back(move(line));
+            queueReady.notify_one();
+        }
+        {
+            lock_guard<mutex> guard(queueLock);
+            finished = true;
+        }
+        queueReady.notify_all();
+        for (auto& t : pool) {
+            t.join();
+        }
+        if (!writeFailed && fflush(output) != 0) writeFailed = true;
+        return !writeFailed;
+    }
+
+private:
+    vector<SolverContext> contexts;
+    deque<string> pending;
+    bool finished = false;
+    mutex queueLock;
+    condition_variable queueReady;
+    condition_variable queueSpace;
+    mutex outputLock;
+    FILE* output = nullptr;
+    atomic<bool> writeFailed{false}; //the rest of the requests of this client are dropped
+
+    void work(SolverContext& ctx) {
+        string request;
+        ostringstream answer;
+        vector<Cell> cells;
+        vector<int> solution;
+        while (true) {
+            {
+                unique_lock<mutex> guard(queueLock);
+                queueReady.wait(guard, [&]() { return finished || !pending.empty(); });
+                if (pending.empty()) return;
+                request = move(pending.front());
+                pending.pop_front();
+            }
+            queueSpace.notify_one();
+            if (writeFailed) continue;
+
+            answer.str("");
+            answerRequest(ctx, request, cells, solution, answer);
+
+            //flush only when no other answer is about to follow
+            string text = answer.str();
+            lock_guard<mutex> guard(outputLock);
+            if (writeFailed) continue;
+            bool idle;
+            {
+                lock_guard<mutex> queueGuard(queueLock);
+                idle = pending.empty();
             }
+            if (fwrite(text.data(), 1, text.size(), output) != text.size() || (idle && fflush(output) != 0)) {
+                writeFailed = true;
+            }
+        }
+    }
 
-            int height = stoi(filename.substr(0, xPos));
-            int width = stoi(filename.substr(xPos + 1, pbPos - xPos - 1));
-            string numberPart = filename.substr(pbPos + 2, dotPos - (pbPos + 2));  
+    void answerRequest(SolverContext& ctx, const string& request, vector<Cell>& cells, vector<int>& solution,
+                       ostream& answer) {
+        const char* p = request.c_str();
+        while (*p == ' ' || *p == '\t') p++;
+        const char* idEnd = p;
+        while (*idEnd && *idEnd != ' ' && *idEnd != '\t') idEnd++;
+        string id(p, idEnd);
+
+        char* next;
+        long long height = strtoll(idEnd, &next, 10);
+        long long width = strtoll(next, &next, 10);
+        const char* error = nullptr;
+        //each side is at most 2^20, so the product fits in a long long (a long is 32 bits on Windows)
+        const long long MAX_CELLS = 1 << 20;
+        if (height <= 0 || width <= 0 || height > MAX_CELLS || width > MAX_CELLS || height * width > MAX_CELLS) {
+            error = "bad board size";
+        }
 
-            Height = height;
-            Width = width;
+        cells.clear();
+        while (!error && (long long)cells.size() < height * width) {
+            char* end;
+            long value = strtol(next, &end, 10);
+            if (end == next) error = "too few cells";
+            else if (value < 0 || value >= BORDER) error = "number out of range";
+            cells.push_back(value);
+            next = end;
+        }
+        if (!error && *next != '\0' && strspn(next, " \t") != strlen(next)) error = "too many cells";
+        if (error || !ctx.loadBoard(height, width, cells.data())) {
+            answer << "{\"name\":\"" << jsonEscaped(id) << "\",\"status\":\"error\",\"message\":\""
+                   << (error ? error : "too many different numbers") << "\"}\n";
+            return;
+        }
 
-            string fullPath = entry.path().string();
+        ctx.resetStats();
+        auto start = chrono::steady_clock::now();
+        bool solved = ctx.solve();
+        //the backtracker also stops at boards that keep empty cells, those are not an answer a client can use
+        if (solved && !ctx.verifySolution()) {
+            solved = false;
+            ctx.stopReason = StopReason::Undecided;
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
-            if (!readBoardFromFile(fullPath)) {
-                cerr << "Cant read: " << fullPath << endl;
-                continue;
+        solution.clear();
+        for (int i = 0; i < ctx.Height; i++) {
+            for (int j = 0; j < ctx.Width; j++) {
+                solution.push_back(ctx.board[i][j]);
             }
+        }
+        writeStatsJson(answer, id, ctx.Height, ctx.Width, ctx.statusName(solved),
+                       seconds, ctx.maxDepth, ctx.nodes, ctx.stats, solution);
+    }
+};
 
-            FillominoSMTSolver solver;
-            string smtOutput = solver.solve(Height, Width, fixedCells);
-
-            //{Height}x{Width}_{number}.txt
-            string outPath = outputDir + to_string(Height) + "x" + to_string(Width) + "_" + numberPart + ".txt";
-
-            ofstream outfile(outPath);
-            if (!outfile) {
-                cerr << "error with: " << outPath << endl;
-                continue;
-            }
+//serves stdin/stdout, or every client of a Unix socket one after the other
+int runSolveService(int threads, const SolveOptions& options, const string& socketPath) {
+#ifndef _WIN32
+    //a client that hangs up early must only end its own stream, not the service
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    SolveService service(threads, options);
+    if (socketPath.empty()) {
+        return service.serve(stdin, stdout) ? 0 : 1;
+    }
+#ifndef _WIN32
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (listener < 0 || socketPath.size() >= sizeof(address.sun_path)) {
+        cerr << "Can't create socket " << socketPath << endl;
+        return 1;
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+    unlink(socketPath.c_str());
+    if (bind(listener, (sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 16) < 0) {
+        cerr << "Can't listen on " << socketPath << endl;
+        close(listener);
+        return 1;
+    }
 
-            outfile << smtOutput;
-            outfile.close();
-            cout << "SMT constraints written to: " << outPath << endl;
+    while (true) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) continue;
+        int writeEnd = dup(client);
+        FILE* in = fdopen(client, "r");
+        FILE* out = writeEnd >= 0 ? fdopen(writeEnd, "w") : nullptr;
+        if (in && out && !service.serve(in, out)) {
+            cerr << "Client closed the connection before reading all answers" << endl;
         }
+        if (in) fclose(in);
+        if (out) fclose(out);
     }
+#else
+    cerr << "Unix sockets are not available on this platform" << endl;
+    return 1;
+#endif
 }
 
-void experiment() {
-    string basePath = "C:\\Users\\Ryan\\Desktop\\baronPuzzles\\";
-    string outputCSV = basePath + "results.csv";
-
-    ofstream csvFile(outputCSV);
-    if (!csvFile.is_open()) {
-        cerr << "Could not open results file for writing.\n";
-        return;
+//reads one of the solver flags shared by the command line modes, false for an unknown flag or value
+bool parseSolveFlag(const string& flag, const string& value, SolveOptions& options) {
+    if (flag == "--cell") {
+        if (value == "first") options.cellHeuristic = CellHeuristic::FirstEmpty;
+        else if (value == "mrv") options.cellHeuristic = CellHeuristic::FewestCandidates;
+        else if (value == "near") options.cellHeuristic = CellHeuristic::NearlyCompleteGroup;
+        else return false;
+    } else if (flag == "--value") {
+        if (value == "ascending") options.valueOrder = ValueOrder::Ascending;
+        else if (value == "slack") options.valueOrder = ValueOrder::GroupSlack;
+        else return false;
+    } else if (flag == "--flood") {
+        if (value == "bfs") options.floodKernel = FloodKernel::Bfs;
+        else if (value == "bitboard") options.floodKernel = FloodKernel::Bitboard;
+        else if (value == "check") options.floodKernel = FloodKernel::Check;
+        else return false;
+    } else if (flag == "--strategies") {
+        if (value == "adaptive") options.strategySchedule = StrategySchedule::Adaptive;
+        else if (value == "fixed") options.strategySchedule = StrategySchedule::Fixed;
+        else return false;
+    } else if (flag == "--kernels") {
+        if (value == "specialized") options.specializedKernels = true;
+        else if (value == "generic") options.specializedKernels = false;
+        else return false;
+    } else if (flag == "--engine") {
+        if (value == "backtracking") options.engine = Engine::Backtracking;
+        else if (value == "sat") options.engine = Engine::Sat;
+        else if (value == "portfolio") options.engine = Engine::Portfolio;
+        else return false;
+    } else if (flag == "--smt-command") {
+        options.smtCommand = value;
+    } else if (flag == "--timeout") {
+        return parseDecimal(value, options.timeLimitSeconds) && options.timeLimitSeconds >= 0;
+    } else if (flag == "--node-budget") {
+        return parseInteger(value, options.nodeBudget) && options.nodeBudget >= 0;
+    } else if (flag == "--prop-budget") {
+        return parseInteger(value, options.propagationBudget) && options.propagationBudget >= 0;
+    } else if (flag == "--tt-mb") {
+        uint64_t megabytes;
+        if (!parseUnsigned(value, megabytes)) return false;
+        options.refutationTableMB = megabytes;
+    } else {
+        return false;
     }
+    return true;
+}
 
-    csvFile << "height,width,boardnum,maxdepth,time_ms\n";
-
-    regex filePattern(R"((\d+)x(\d+)PB(\d+)\.txt)");
-
-    for (const auto& entry : fs::directory_iterator(basePath)) {
-        if (!entry.is_regular_file()) continue;
-
-        string filename = entry.path().filename().string();
-        smatch match;
-
-        if (!regex_match(filename, match, filePattern)) continue;
 
-        int height = stoi(match[1]);
-        int width = stoi(match[2]);
-        int boardnum = stoi(match[3]);
+atomic<bool> interrupted{false};
 
-        string fullPath = entry.path().string();
-        cout << "Processing " << filename << endl;
+extern "C" void onInterrupt(int) {
+    interrupted = true;
+}
 
-        if (!readBoardFromFile(fullPath)) {
-            cout << "Failed to read " << filename << endl;
-            continue;
+int main(int argc, char* argv[]) {
+    if (argc >= 3 && string(argv[1]) == "bench") {
+        //FlmSlv bench <puzzle directory or corpus>... [--repeat N] [--warmup N]
+        //             [--csv <file>] [--json <file>] [--compare <old csv>] [--threshold percent] [solver flags of batch]
+        vector<string> sources;
+        SolveOptions options;
+        BenchOptions bench;
+        for (int k = 2; k < argc; k++) {
+            string arg = argv[k];
+            if (arg.rfind("--", 0) != 0) {
+                sources.push_back(arg);
+                continue;
+            }
+            if (k + 1 >= argc) {
+                cerr << "Missing value for " << arg << endl;
+                return 1;
+            }
+            string value = argv[++k];
+            bool good = true;
+            if (arg == "--repeat") good = parseInteger(value, bench.repeat);
+            else if (arg == "--warmup") good = parseInteger(value, bench.warmup);
+            else if (arg == "--csv") bench.csvPath = value;
+            else if (arg == "--json") bench.jsonPath = value;
+            else if (arg == "--compare") bench.comparePath = value;
+            else if (arg == "--threshold") good = parseDecimal(value, bench.thresholdPercent);
+            else good = parseSolveFlag(arg, value, options);
+            if (!good) {
+                cerr << "Bad option: " << arg << endl;
+                return 1;
+            }
+            bench.repeat = max(1, bench.repeat);
+            bench.warmup = max(0, bench.warmup);
         }
-
-        maxDepth = 0;
-        auto start = chrono::high_resolution_clock::now();
-        bool solved = solveWithBacktracking();
-        auto end = chrono::high_resolution_clock::now();
-        auto duration = chrono::duration_cast<chrono::milliseconds>(end - start).count();
-
-        if (solved) {
-            cout << "Solved " << filename << ", maxDepth: " << maxDepth << endl;
-        } else {
-            cout << "Could not solve " << filename << endl;
-            exit(1);
+        if (!bench.comparePath.empty() && bench.csvPath.empty()) bench.csvPath = "bench.csv";
+        return benchmark(sources, options, bench) ? 0 : 1;
+    }
+    if (argc >= 2 && string(argv[1]) == "serve") {
+        //FlmSlv serve [threads] [--socket <path>] [solver flags of batch], requests are described at SolveService
+        int threads = thread::hardware_concurrency();
+        SolveOptions options;
+        string socketPath;
+        for (int k = 2; k < argc; k++) {
+            string arg = argv[k];
+            if (arg.rfind("--", 0) != 0) {
+                if (!parseInteger(arg, threads)) {
+                    cerr << "Bad option: " << arg << endl;
+                    return 1;
+                }
+            } else if (arg == "--socket" && k + 1 < argc) {
+                socketPath = argv[++k];
+            } else if (k + 1 >= argc || !parseSolveFlag(arg, argv[++k], options)) {
+                cerr << "Bad option: " << arg << endl;
+                return 1;
+            }
         }
-
-        csvFile << height << "," << width << "," << boardnum << ","
-                << maxDepth << "," << duration << "\n";
+        return runSolveService(max(1, threads), options, socketPath);
+    }
+    if (argc >= 4 && string(argv[1]) == "compare") {
+        //FlmSlv compare <old csv> <new csv> [threshold percent]
+        double threshold = 10;
+        if (argc >= 5 && !parseDecimal(argv[4], threshold)) {
+            cerr << "Bad threshold: " << argv[4] << endl;
+            return 1;
+        }
+        return compareBenchRuns(argv[2], argv[3], threshold) ? 0 : 1;
+    }
+    if (argc >= 4 && string(argv[1]) == "pack") {
+        //FlmSlv pack <puzzle directory> <corpus file>
+        return packPuzzles(argv[2], argv[3]) ? 0 : 1;
+    }
+    if (argc >= 4 && string(argv[1]) == "check") {
+        //FlmSlv check <puzzle directory> <solver output directory> [threads]
+        int threads = thread::hardware_concurrency();
+        if (argc >= 5 && !parseInteger(argv[4], threads)) {
+            cerr << "Bad option: " << argv[4] << endl;
+            return 1;
+        }
+        return checkSMTsolutions(argv[2], argv[3], max(1, threads)) ? 0 : 1;
+    }
+    if (argc >= 4 && string(argv[1]) == "smt") {
+        //FlmSlv smt <puzzle directory> <output directory> [threads] [--residual standard|open]
+        int threads = thread::hardware_concurrency();
+        ResidualMode residual = ResidualMode::None;
+        for (int k = 4; k < argc; k++) {
+            string arg = argv[k];
+            if (arg == "--residual" && k + 1 < argc) {
+                string mode = argv[++k];
+                if (mode == "standard") residual = ResidualMode::Standard;
+                else if (mode == "open") residual = ResidualMode::Open;
+                else {
+                    cerr << "Bad residual mode: " << mode << endl;
+                    return 1;
+                }
+            } else if (arg.rfind("--", 0) != 0 && parseInteger(arg, threads)) {
+                continue;
+            } else {
+                cerr << "Bad option: " << arg << endl;
+                return 1;
+            }
+        }
+        return txtFilesToSMT(argv[2], argv[3], max(1, threads), residual) ? 0 : 1;
+    }
+    if (argc >= 5 && string(argv[1]) == "generate") {
+        //FlmSlv generate <height> <width> <count> [threads] [--seed N] [--max-number N]
+        //                [--difficulty any|easy|hard] [--out <directory>] [--corpus <file>]
+        GeneratorOptions options;
+        if (!parseInteger(argv[2], options.height) || !parseInteger(argv[3], options.width) ||
+            !parseInteger(argv[4], options.count) || options.count < 0) {
+            cerr << "Bad size or count: " << argv[2] << " " << argv[3] << " " << argv[4] << endl;
+            return 1;
+        }
+        int threads = thread::hardware_concurrency();
+        for (int k = 5; k < argc; k++) {
+            string arg = argv[k];
+            if (arg.rfind("--", 0) != 0) {
+                if (!parseInteger(arg, threads)) {
+                    cerr << "Bad option: " << arg << endl;
+                    return 1;
+                }
+                continue;
+            }
+            if (k + 1 >= argc) {
+                cerr << "Missing value for " << arg << endl;
+                return 1;
+            }
+            string value = argv[++k];
+            if (arg == "--seed" && parseUnsigned(value, options.seed)) continue;
+            else if (arg == "--max-number" && parseInteger(value, options.maxNumber)) continue;
+            else if (arg == "--out") options.outDir = value;
+            else if (arg == "--corpus") options.corpusPath = value;
+            else if (arg == "--difficulty" && value == "any") options.difficulty = Difficulty::Any;
+            else if (arg == "--difficulty" && value == "easy") options.difficulty = Difficulty::Easy;
+            else if (arg == "--difficulty" && value == "hard") options.difficulty = Difficulty::Hard;
+            else {
+                cerr << "Bad option: " << arg << " " << value << endl;
+                return 1;
+            }
+        }
+        return generatePuzzles(options, max(1, threads)) ? 0 : 1;
+    }
+    if (argc >= 3 && string(argv[1]) == "count") {
+        //FlmSlv count <puzzle directory, corpus or .txt file> [threads] [--limit N] [solver flags of batch]
+        //counts solutions up to N (default 2, enough to prove uniqueness), exits with 0 when all are unique.
+        //The SAT engine is the default since it also sees regions without a clue. A single puzzle is counted by
+        //all threads with either engine, several puzzles are spread over the threads.
+        int threads = thread::hardware_concurrency();
+        long long limit = 2;
+        SolveOptions options;
+        options.engine = Engine::Sat;
+        for (int k = 3; k < argc; k++) {
+            string arg = argv[k];
+            if (arg.rfind("--", 0) != 0) {
+                if (!parseInteger(arg, threads)) {
+                    cerr << "Bad option: " << arg << endl;
+                    return 1;
+                }
+            } else if (arg == "--limit" && k + 1 < argc && parseInteger(argv[k + 1], limit)) {
+                limit = max(1LL, limit);
+                k++;
+            } else if (k + 1 >= argc || !parseSolveFlag(arg, argv[++k], options)) {
+                cerr << "Bad option: " << arg << endl;
+                return 1;
+            }
+        }
+        return countPuzzles(argv[2], max(1, threads), limit, options) ? 0 : 1;
     }
+    if (argc >= 3 && (string(argv[1]) == "batch" || string(argv[1]) == "solve")) {
+        //FlmSlv batch <puzzle directory or corpus file> [threads] [--cell first|mrv|near] [--value ascending|slack] [--tt-mb N]
+        //             [--flood bfs|bitboard|check], check runs both flood kernels and counts where they disagree
+        //             [--kernels specialized|generic], generic skips the instances compiled for common board sizes
+        //             [--strategies adaptive|fixed], fixed runs every deduction strategy at every node in table order
+        //             [--engine backtracking|sat] [--timeout seconds] [--node-budget N] [--prop-budget N]
+        //             [--csv <file>] [--json <file>]
+        //FlmSlv solve <puzzle file> [threads] [same flags], one puzzle searched by all threads. Exits with 0 when
+        //solved, 2 when the board has no solution and 3 when a limit stopped the search or it stayed undecided
+        int threads = thread::hardware_concurrency();
+        SolveOptions options;
+        string csvPath, jsonPath;
+        for (int k = 3; k < argc; k++) {
+            string arg = argv[k];
+            if (arg.rfind("--", 0) != 0) {
+                if (!parseInteger(arg, threads)) {
+                    cerr << "Bad option: " << arg << endl;
+                    return 1;
+                }
+            } else if (arg == "--csv" && k + 1 < argc) {
+                csvPath = argv[++k];
+            } else if (arg == "--json" && k + 1 < argc) {
+                jsonPath = argv[++k];
+            } else if (k + 1 >= argc || !parseSolveFlag(arg, argv[++k], options)) {
+                cerr << "Bad option: " << arg << endl;
+                return 1;
+            }
+        }
+        threads = max(1, threads);
 
-    csvFile.close();
-}
+        if (string(argv[1]) == "batch") {
+            batchSolve(argv[2], threads, options, csvPath, jsonPath);
+            return 0;
+        }
 
+        SolverContext ctx;
+        ctx.options = options;
+        if (!ctx.readBoardFromFile(argv[2])) {
+            return 1;
+        }
+        auto start = chrono::steady_clock::now();
+        //Ctrl-C stops the search and shows how far the board got
+        ctx.cancel = &interrupted;
+        signal(SIGINT, onInterrupt);
+        bool solved = ctx.solve(threads);
+        signal(SIGINT, SIG_DFL);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        ctx.displayBoard();
+        cout << ctx.statusName(solved) << " on " << threads << " threads, maxDepth: " << ctx.maxDepth
+             << ", nodes: " << ctx.nodes << ", refuted hits/misses: " << ctx.refutedHits << "/" << ctx.refutedMisses
+             << ", time: " << seconds << "s" << endl;
+        if (solved) return 0;
+        return ctx.stopReason == StopReason::None ? 2 : 3;
+    }
 
-int main() {
+    SolverContext ctx;
     char choice;
     while (true) {
         cout << "Choose an option:" << endl
@@ -1079,7 +5007,7 @@ int main() {
             cout << "Enter filename to load board: ";
             cin >> filename;
 
-            if (readBoardFromFile(filename)) {
+            if (ctx.readBoardFromFile(filename)) {
                 cout << "Board loaded successfully" << endl;
             } else {
                 cout << "Failed to load board from file" << endl;
@@ -1087,10 +5015,10 @@ int main() {
         }
         else if (choice == 'd') {
             pair<int, int> whichCell;
-            cout << " " << checkIfEmptyCellCanBeReachedByOneNum(whichCell) << " " << whichCell.first << "," << whichCell.second;
+            cout << " " << ctx.checkIfEmptyCellCanBeReachedByOneNum(whichCell) << " " << whichCell.first << "," << whichCell.second;
         } else if (choice == 'e') {
             pair<int, int> exitcell;
-            cout << " " << checkSingleExitGroups(exitcell) << "" << exitcell.first << "," << exitcell.second;
+            cout << " " << ctx.checkSingleExitGroups(exitcell) << "" << exitcell.first << "," << exitcell.second;
         } else if (choice == 'b') { 
             int row, col, num;
             cout << "Enter row (0-based index): ";
@@ -1100,7 +5028,7 @@ int main() {
             cout << "Enter number to place: ";
             cin >> num;
     
-            if (fillCell(row, col,num)) {
+            if (ctx.fillCell(row, col,num)) {
                 cout << "Cell (" << row << "," << col << ") was successfully filled." << endl;
             } else {
                 cout << "Failed to fill cell (" << row << "," << col << ")" << endl;
@@ -1112,18 +5040,18 @@ int main() {
             cout << "Enter column (0-based index): ";
             cin >> col;
     
-            if (removeCell(row, col)) {
+            if (ctx.removeCell(row, col)) {
                 cout << "Cell (" << row << "," << col << ") was successfully removed." << endl;
             } else {
                 cout << "This cell is out of bounds" << endl;
             }
         }
         else if(choice == 'f'){
-            checkIncompleteGroups();
+            ctx.checkIncompleteGroups();
         }
         else if(choice == 'g'){
             pair<int, int> defCell;
-            int defNumber = findDefinitiveNumber(defCell);
+            int defNumber = ctx.findDefinitiveNumber(defCell);
             if(defNumber != -1){
                 cout << "Number for cell (" << defCell.first << "," << defCell.second << ") has to be " << defNumber << endl;
             }
@@ -1133,7 +5061,7 @@ int main() {
             
         }
         else if(choice == 'h'){
-            if(!existsOverfilledGroup()){
+            if(!ctx.existsOverfilledGroup()){
                 cout << "There are no overfilled groups" << endl;
             }
             else{
@@ -1142,7 +5070,7 @@ int main() {
             
         }
         else if(choice == 'i'){
-            if(allGroupsAreExactlyFilled()){
+            if(ctx.allGroupsAreExactlyFilled()){
                 cout << "All groups have the correct number of cells" << endl;
             }
             else{
@@ -1151,7 +5079,6 @@ int main() {
         }
         else if (choice == 'j') {
             FillominoSMTSolver solver;
-            string smtOutput = solver.solve(Height, Width, fixedCells);
 
             int suffix = 0;
             string baseName = "satoutputformat";
@@ -1164,12 +5091,15 @@ int main() {
                 filename = baseName + to_string(suffix) + extension;
             }
 
-            ofstream outfile(filename);
+            FILE* outfile = fopen(filename.c_str(), "wb");
             if (!outfile) {
                 cout << "Can't open output file: " << filename << endl;
             } else {
-                outfile << smtOutput;
-                outfile.close();
+                {
+                    SmtWriter out(outfile);
+                    solver.write(out, ctx.Height, ctx.Width, ctx.fixedCells);
+                }
+                fclose(outfile);
                 cout << "Constraints written to " << filename << endl;
             }
         }
@@ -1178,40 +5108,46 @@ int main() {
             std::cout << "enter filename of SMT solver output: ";
             std::cin >> filename;
 
-            if (loadSMTsolvedBoard(filename)) {
+            if (ctx.loadSMTsolvedBoard(filename)) {
                 std::cout << "Solution has been set" << std::endl;
             }
 
-            findAndStoreGroups();
+            ctx.findAndStoreGroups();
         }
         else if(choice ==  '1'){
-            KeepCheckingSingleExits();
+            while (ctx.sweepSingleExits()) {}
         }
         else if(choice == '2'){
-            KeepCheckingEmptyReachableCells();
+            while (ctx.sweepSingleReachableNumbers()) {}
         }
         else if(choice == '3'){
-            keepFillingDefinitiveNumbers();
+            while (ctx.sweepDefinitiveNumbers()) {}
         }
         else if (choice == '4') {
             if(showDepth){
-                depthGapHistogram.clear();
+                ctx.depthGapHistogram.clear();
             }
             
-            solveWithBacktracking();
+            ctx.solveWithBacktracking();
             if(showDepth){
                 std::cout << endl << "Backtrack depth gap histogram (gap -> count):" << endl;
-                for (const auto& entry : depthGapHistogram) {
+                for (const auto& entry : ctx.depthGapHistogram) {
                     std::cout << "Gap " << entry.first << " -> " << entry.second << " times" << endl;
                 }
             }
             
         }
         else if(choice == '5'){
-            fillSingleExitCellsAndSafeMoves();
+            ctx.fillSingleExitCellsAndSafeMoves();
         }
         else if (choice == '6') {
-            experiment();
+            string dir;
+            cout << "enter puzzle directory: ";
+            cin >> dir;
+
+            BenchOptions bench;
+            bench.csvPath = (fs::path(dir) / "results.csv").string();
+            benchmark({dir}, ctx.options, bench);
         }
         else if (choice == '7') {
             break;
@@ -1221,7 +5157,7 @@ int main() {
         }
 
         // display board after every action
-        displayBoard();
+        ctx.displayBoard();
     }
 
     return 0;